@@ -0,0 +1,18 @@
+#version 450
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+// Per instance
+layout(location = 2) in vec2 instOffset;
+layout(location = 3) in vec2 instScale;
+layout(location = 4) in vec4 instColor;
+layout(location = 5) in float instRotation;
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    float c = cos(instRotation);
+    float s = sin(instRotation);
+    vec2 p = inPosition.xy * instScale;
+    p = vec2(p.x * c - p.y * s, p.x * s + p.y * c) + instOffset;
+    gl_Position = vec4(p, inPosition.z, 1.0);
+    fragColor = inColor * instColor.rgb;
+}
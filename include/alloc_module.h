@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#define ALLOC_DUMP_INTERVAL_MS 10000 // alloc_tick prints a report this often
+
+// Object type a set of callbacks is handed to, counted separately
+typedef enum {
+    ALLOC_OBJECT_INSTANCE,
+    ALLOC_OBJECT_DEVICE,
+    ALLOC_OBJECT_SURFACE,
+    ALLOC_OBJECT_SWAPCHAIN,
+    ALLOC_OBJECT_IMAGE_VIEW,
+    ALLOC_OBJECT_FRAMEBUFFER,
+    ALLOC_OBJECT_RENDER_PASS,
+    ALLOC_OBJECT_PIPELINE,
+    ALLOC_OBJECT_SHADER_MODULE,
+    ALLOC_OBJECT_COMMAND_POOL,
+    ALLOC_OBJECT_SYNC,
+    ALLOC_OBJECT_BUFFER,
+    ALLOC_OBJECT_IMAGE, // Images and samplers
+    ALLOC_OBJECT_MEMORY,
+    ALLOC_OBJECT_DESCRIPTOR,
+    ALLOC_OBJECT_DEBUG,
+    ALLOC_OBJECT_IMGUI,
+    ALLOC_OBJECT_COUNT
+} AllocObjectType;
+
+#define ALLOC_SCOPE_COUNT 5 // VK_SYSTEM_ALLOCATION_SCOPE_COMMAND .. _INSTANCE
+
+typedef struct {
+    uint64_t allocations; // pfnAllocation + pfnReallocation calls
+    uint64_t frees;
+    uint64_t liveBytes;
+    uint64_t peakBytes;
+    uint64_t totalBytes; // Bytes ever requested, shows churn
+    uint64_t internalBytes; // Driver internal allocations reported through notifications
+} AllocCounters;
+
+typedef struct {
+    VkBool32 enabled;
+    AllocCounters objects[ALLOC_OBJECT_COUNT];
+    AllocCounters scopes[ALLOC_SCOPE_COUNT];
+    AllocCounters total;
+} AllocStats;
+
+// Callbacks to pass to vkCreate*/vkDestroy* (NULL when tracking is compiled out).
+// Create and destroy of one object must use the same type.
+const VkAllocationCallbacks* vk_allocator(AllocObjectType type);
+
+void alloc_get_stats(AllocStats* stats);
+void alloc_dump(void);
+void alloc_tick(void); // Periodic dump, call once per frame
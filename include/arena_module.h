@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every thread gets its own frame and scratch arena on first use, freed when the thread exits
+#define FRAME_ARENA_SIZE (4 * 1024 * 1024)   // Reset by the owning thread at its frame boundary
+#define SCRATCH_ARENA_SIZE (2 * 1024 * 1024) // Stack-like temporaries, released by scope
+
+// Linear (bump) allocator over one fixed block
+typedef struct {
+    char* base;
+    size_t capacity;
+    size_t head;
+    size_t peak;
+} Arena;
+
+void arena_init(Arena* arena, size_t capacity);
+void arena_destroy(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size, size_t alignment);
+void arena_reset(Arena* arena);
+
+// Scratch scope: everything allocated after scratch_begin is dropped by scratch_end
+typedef struct {
+    size_t mark;
+} ScratchScope;
+
+typedef struct {
+    uint32_t lastFrameHeapAllocations; // Should read 0 in steady state
+    uint32_t steadyFrames;             // Consecutive frames without a heap allocation
+    uint64_t totalHeapAllocations;
+} ArenaStats;
+
+// Peaks of the calling thread's arenas
+typedef struct {
+    size_t framePeak;
+    size_t scratchPeak;
+} ThreadArenaStats;
+
+// init_arenas hooks SDL and ImGui allocations, call it before SDL_Init
+void init_arenas(void);
+void cleanup_arenas(void); // Frees the calling thread's arenas, other threads free theirs on exit
+void arena_frame_begin(void); // Resets the calling thread's frame arena
+void heap_frame_end(void);    // Closes one frame of the heap allocation count, main thread only
+
+void* frame_alloc(size_t size);   // Valid until this thread's next arena_frame_begin
+ScratchScope scratch_begin(void);
+void* scratch_alloc(size_t size); // Exits when called outside a scratch_begin/scratch_end scope
+void scratch_end(ScratchScope scope);
+
+// Counted heap allocation for long-lived data
+void* heap_alloc(size_t size);
+void* heap_realloc(void* memory, size_t size);
+void heap_free(void* memory);
+void heap_count_allocation(void); // For allocations made by other allocators (SDL, ImGui)
+
+void arena_get_stats(ArenaStats* stats); // Main thread only, like heap_frame_end
+void arena_get_thread_stats(ThreadArenaStats* stats);
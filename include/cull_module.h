@@ -0,0 +1,29 @@
+#pragma once
+
+#include "vulkan_module.h"
+#include "encoder_module.h"
+#include "triangle_module.h"
+
+// GPU-driven instanced quads: the instances stay in a device buffer, a compute pass culls them
+// against a clip-space rectangle and compacts the survivors, counting them into an indirect draw
+// command, and the scene draws them with one vkCmdDrawIndexedIndirect however many there are.
+
+#define CULL_GROUP_SIZE 64 // local_size_x of quad_cull.comp
+
+typedef struct {
+    uint32_t instances; // Uploaded
+    uint32_t visible;   // Survivors of the last completed cull, read back from its draw command
+} CullStats;
+
+void init_cull(void);
+void cleanup_cull(void);
+
+// Replace the instance set. The copy is queued on the upload queue, so call upload_flush before
+// vulkan_begin_frame and the frame acquires it.
+void cull_set_instances(const QuadInstance* instances, uint32_t count);
+// Records the culling dispatch; after vulkan_begin_frame, outside any render pass.
+// bounds is the visible clip-space rectangle: min x, min y, max x, max y.
+void cull_dispatch(VkCommandBuffer commandBuffer, const float bounds[4]);
+// One indirect draw of this frame's survivors, inside the scene pass; safe on record workers
+void cull_draw(CommandEncoder* encoder);
+void cull_get_stats(CullStats* stats);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "memory_module.h"
+
+// Deferred destruction: objects are queued with the frame being recorded and destroyed
+// by vk_defer_sweep once the frame timeline says the GPU is done with them.
+
+// handle is the object cast to uint64_t, as in VkDebugUtilsObjectNameInfoEXT
+void vk_defer_destroy(uint64_t handle, VkObjectType type);
+// Buffer plus its sub-allocation; clears both so the caller can't reuse them
+void vk_defer_destroy_buffer(VkBuffer* buffer, MemoryAllocation* allocation);
+// Memory shared by several objects; queue it after them so it outlives all of them
+void vk_defer_free(MemoryAllocation* allocation);
+
+void vk_defer_sweep(void); // Once per frame, after the frame slot has been waited on
+void vk_defer_flush(void); // Destroy everything now, only once the device is idle
+uint32_t vk_defer_pending(void);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vulkan_module.h"
+
+// Command encoder: records into one command buffer and remembers what is bound, so a bind or
+// dynamic state call that would not change anything is dropped. One per command buffer, kept
+// on the stack of whichever thread records it. Pipelines are assumed to take viewport and
+// scissor as dynamic state, so binding one does not disturb them.
+
+#define ENCODER_MAX_DESCRIPTOR_SETS 4
+#define ENCODER_MAX_VERTEX_BINDINGS 2 // Per-vertex pool plus one per-instance stream
+
+typedef enum {
+    ENCODER_CALL_PIPELINE,
+    ENCODER_CALL_DESCRIPTOR_SETS,
+    ENCODER_CALL_VERTEX_BUFFER,
+    ENCODER_CALL_INDEX_BUFFER,
+    ENCODER_CALL_VIEWPORT,
+    ENCODER_CALL_SCISSOR,
+    ENCODER_CALL_DRAW, // Never elided, for the calls-per-draw ratio
+    ENCODER_CALL_COUNT
+} EncoderCall;
+
+typedef struct CommandEncoder {
+    VkCommandBuffer commandBuffer;
+    VkPipeline pipeline;
+    VkPipelineLayout layout; // Of the bound descriptor sets
+    VkDescriptorSet sets[ENCODER_MAX_DESCRIPTOR_SETS];
+    VkBuffer vertexBuffers[ENCODER_MAX_VERTEX_BINDINGS];
+    VkDeviceSize vertexOffsets[ENCODER_MAX_VERTEX_BINDINGS];
+    VkBuffer indexBuffer;
+    VkDeviceSize indexOffset;
+    VkIndexType indexType;
+    VkViewport viewport;
+    VkRect2D scissor;
+    VkBool32 viewportValid;
+    VkBool32 scissorValid;
+    uint32_t issued[ENCODER_CALL_COUNT];
+    uint32_t skipped[ENCODER_CALL_COUNT];
+} CommandEncoder;
+
+// Summed over every command buffer recorded in the last frame, secondaries included
+typedef struct {
+    uint32_t issued[ENCODER_CALL_COUNT];
+    uint32_t skipped[ENCODER_CALL_COUNT];
+    uint32_t totalIssued;
+    uint32_t totalSkipped;
+} EncoderStats;
+
+void encoder_begin(CommandEncoder* encoder, VkCommandBuffer commandBuffer); // After vkBeginCommandBuffer
+void encoder_end(CommandEncoder* encoder); // Before vkEndCommandBuffer, adds its counters to the frame's
+// Something recorded without the encoder (ImGui, vkCmdExecuteCommands); forget what is bound
+void encoder_invalidate(CommandEncoder* encoder);
+
+void encoder_bind_pipeline(CommandEncoder* encoder, VkPipeline pipeline);
+void encoder_bind_descriptor_sets(CommandEncoder* encoder, VkPipelineLayout layout, uint32_t firstSet, uint32_t count, const VkDescriptorSet* sets);
+void encoder_bind_vertex_buffer(CommandEncoder* encoder, uint32_t binding, VkBuffer buffer, VkDeviceSize offset);
+void encoder_bind_index_buffer(CommandEncoder* encoder, VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType);
+void encoder_set_viewport(CommandEncoder* encoder, const VkViewport* viewport);
+void encoder_set_scissor(CommandEncoder* encoder, const VkRect2D* scissor);
+void encoder_draw(CommandEncoder* encoder, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
+void encoder_draw_indexed(CommandEncoder* encoder, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+// Counted as one draw, whatever the GPU-written commands expand to
+void encoder_draw_indexed_indirect(CommandEncoder* encoder, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride);
+
+// Render thread, around each frame; counters from outside a frame (benchmarks) are dropped
+void encoder_frame_begin(void);
+void encoder_frame_end(void);
+void encoder_get_stats(EncoderStats* stats);
+const char* encoder_call_name(EncoderCall call);
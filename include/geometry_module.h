@@ -0,0 +1,61 @@
+#pragma once
+
+#include "vulkan_module.h"
+#include "encoder_module.h"
+
+#define GEOMETRY_VERTEX_STRIDE (6 * sizeof(float)) // vec3 position + vec3 color
+#define GEOMETRY_BLOCK_SIZE (4 * 1024 * 1024) // Pools grow and shrink in blocks of this size
+#define GEOMETRY_MAX_BLOCKS 32 // Per pool
+#define GEOMETRY_DEFRAG_BYTES_PER_FRAME (1024 * 1024) // GPU copy budget of one defrag step
+#define GEOMETRY_DEFRAG_THRESHOLD 0.25f // Auto-start a pass above this fragmentation
+
+// Mesh addressed by element offsets into a block of the shared vertex/index pools.
+// The pool keeps a pointer to the handle and patches it when defrag moves the mesh.
+typedef struct {
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount; // 0 for non-indexed meshes
+    uint16_t vertexBlock;
+    uint16_t indexBlock;
+} MeshHandle;
+
+// Fragmentation = 1 - largestFree / freeBytes, 0 when all free space is contiguous
+typedef struct {
+    VkDeviceSize vertexFreeBytes;
+    VkDeviceSize vertexLargestFree;
+    float vertexFragmentation;
+    VkDeviceSize indexFreeBytes;
+    VkDeviceSize indexLargestFree;
+    float indexFragmentation;
+    VkDeviceSize vertexPoolBytes; // Footprint of the live blocks
+    uint32_t vertexBlocks;
+    VkDeviceSize indexPoolBytes;
+    uint32_t indexBlocks;
+    VkDeviceSize releasedBytes; // Blocks handed back to the memory module since init
+    uint32_t meshCount;
+    VkBool32 defragActive;
+} GeometryStats;
+
+void init_geometry(void);
+void cleanup_geometry(void);
+
+// Upload a mesh into the pools, adding a block when none has room; copies are batched until upload_flush.
+// The handle must stay at the same address until geometry_destroy_mesh.
+void geometry_create_mesh(const float* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, MeshHandle* mesh);
+void geometry_destroy_mesh(MeshHandle* mesh);
+
+// Bind the blocks a mesh lives in; the draws do this themselves, and the encoder drops it
+// when consecutive meshes share a block
+void geometry_bind_mesh(CommandEncoder* encoder, const MeshHandle* mesh);
+void geometry_draw(CommandEncoder* encoder, const MeshHandle* mesh);
+// Same, repeated instanceCount times; per-instance data comes from whatever is bound at binding 1
+void geometry_draw_instanced(CommandEncoder* encoder, const MeshHandle* mesh, uint32_t instanceCount, uint32_t firstInstance);
+
+// Incremental compaction into the lowest blocks, so the emptied ones can be released.
+// geometry_defrag_step records copies and must run outside a render pass.
+void geometry_defrag_begin(void);
+void geometry_defrag_step(VkCommandBuffer commandBuffer);
+void geometry_get_stats(GeometryStats* stats);
+// Bumped whenever a mesh is created, destroyed or moved; cached command buffers are keyed on it
+uint32_t geometry_generation(void);
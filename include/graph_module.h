@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vulkan_module.h"
+#include "encoder_module.h"
+
+// Frame graph: every frame the renderer declares its passes and the images each one reads and
+// writes, then graph_execute works out the rest. Passes nothing presented depends on are culled,
+// consecutive passes drawing into the same attachments share one render pass instance, transient
+// images with disjoint lifetimes share memory, and only the barriers the accesses need are recorded.
+
+#define GRAPH_MAX_PASSES 16
+#define GRAPH_MAX_RESOURCES 16
+#define GRAPH_MAX_PASS_ACCESSES 8     // Reads plus writes of one pass
+#define GRAPH_MAX_COLOR_ATTACHMENTS 4
+#define GRAPH_MAX_RENDER_PASSES 16    // Cached VkRenderPass objects, one per attachment setup
+#define GRAPH_MAX_FRAMEBUFFERS 32     // Cached framebuffers, flushed when full or invalidated
+#define GRAPH_NONE UINT32_MAX
+
+typedef uint32_t GraphResource;
+
+typedef enum {
+    GRAPH_USAGE_COLOR_ATTACHMENT, // A write; the pass is recorded inside a render pass
+    GRAPH_USAGE_SAMPLED,          // Fragment shader read
+    GRAPH_USAGE_TRANSFER_SRC,
+    GRAPH_USAGE_TRANSFER_DST,
+    GRAPH_USAGE_COUNT
+} GraphUsage;
+
+// Handed to every pass callback
+typedef struct {
+    VkRenderPass renderPass;   // VK_NULL_HANDLE for passes without color attachments
+    VkFramebuffer framebuffer;
+    VkExtent2D extent;         // Render area; viewport and scissor are already set to it
+    VkSubpassContents contents;
+} GraphPassContext;
+
+typedef void (*GraphPassFunc)(CommandEncoder* encoder, const GraphPassContext* context, void* userData);
+
+typedef struct {
+    uint32_t passes;             // Declared last frame
+    uint32_t culledPasses;
+    uint32_t renderPasses;       // Render pass instances after merging
+    uint32_t barriers;           // Image barriers recorded
+    uint32_t transientImages;
+    VkDeviceSize transientBytes; // Memory backing the transient images
+    VkDeviceSize aliasedBytes;   // Saved by placing them in the same memory
+} GraphStats;
+
+void init_graph(void);
+void cleanup_graph(void);
+void graph_invalidate(void); // Swapchain views changed, drop framebuffers built on them
+
+// Declaration, once per frame between vulkan_begin_frame and vulkan_end_frame
+void graph_begin(void);
+// The acquired image; it starts undefined and ends the frame in PRESENT_SRC
+GraphResource graph_import_swapchain(uint32_t imageIndex);
+// Graph-owned image, contents do not survive the frame
+GraphResource graph_create_image(const char* name, VkFormat format, VkExtent2D extent);
+uint32_t graph_add_pass(const char* name, GraphPassFunc func, void* userData, VkSubpassContents contents);
+void graph_read(uint32_t pass, GraphResource resource, GraphUsage usage);
+void graph_write(uint32_t pass, GraphResource resource, GraphUsage usage);
+// Color attachment write that clears instead of loading the previous contents
+void graph_write_clear(uint32_t pass, GraphResource resource, VkClearColorValue color);
+// Culls, merges, places transients and records every surviving pass through the encoder
+void graph_execute(CommandEncoder* encoder);
+
+// For pass callbacks that address images directly (copies, blits)
+VkImage graph_image(GraphResource resource);
+VkExtent2D graph_extent(GraphResource resource);
+void graph_get_stats(GraphStats* stats);
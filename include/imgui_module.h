@@ -2,7 +2,57 @@
 
 #include <SDL3/SDL.h>
 #include "vulkan_module.h"
+#include "encoder_module.h"
+#include "cimgui.h"
+
+#define IMGUI_SNAPSHOT_MAX_LISTS 64 // Draw lists (windows, popups, tooltips) copied per frame
+#define IMGUI_MAX_TEXTURE_REQUESTS 32 // Texture changes on their way to the render thread
+
+// One texture change ImGui asked for, applied by the render thread to its own copy of the texture
+typedef struct {
+    uint32_t serial;        // Increasing; the render thread skips serials it has already applied
+    ImTextureStatus status; // WantCreate, WantUpdates or WantDestroy
+    ImTextureData* texture; // The render thread's twin of ImGui's texture, never ImGui's own
+    ImTextureFormat format;
+    int width;
+    int height;
+    int bytesPerPixel;
+    ImTextureRect rect;     // Region to upload
+    unsigned char* pixels;  // Copy of the whole texture, freed once the render thread has applied it
+} ImGuiTextureRequest;
+
+// Copy of one draw list's output; the buffers only grow, so steady state does not allocate
+typedef struct {
+    ImDrawList list; // Shallow copy with CmdBuffer/VtxBuffer/IdxBuffer pointed at the arrays below
+    ImDrawCmd* commands;
+    ImDrawVert* vertices;
+    ImDrawIdx* indices;
+    int commandCapacity;
+    int vertexCapacity;
+    int indexCapacity;
+} ImGuiSnapshotList;
+
+// Draw data that outlives igNewFrame, so another thread can render it while the next UI frame is built
+typedef struct {
+    ImDrawData drawData;
+    ImDrawList* listPointers[IMGUI_SNAPSHOT_MAX_LISTS];
+    ImGuiSnapshotList lists[IMGUI_SNAPSHOT_MAX_LISTS];
+    ImGuiTextureRequest textures[IMGUI_MAX_TEXTURE_REQUESTS]; // Resent until acknowledged, oldest first
+    uint32_t textureCount;
+} ImGuiSnapshot;
 
 void init_imgui(SDL_Window* window);
 void cleanup_imgui(void);
-void render_imgui(uint32_t imageIndex); // for rendering
\ No newline at end of file
+void render_imgui(CommandEncoder* encoder, ImDrawData* drawData); // for rendering, leaves the encoder invalidated
+
+// Main thread, after igRender: turn texture requests (font atlas) into copies for the render thread,
+// dropping those it has acknowledged, then copy the draw data
+void imgui_queue_textures(uint32_t appliedSerial);
+void imgui_snapshot_capture(ImGuiSnapshot* snapshot);
+void imgui_snapshot_release(ImGuiSnapshot* snapshot);
+
+// Render thread, before recording: apply the snapshot's texture requests
+void imgui_apply_textures(const ImGuiSnapshot* snapshot);
+uint32_t imgui_textures_applied(void); // Last applied serial, handed back through RenderStats
+// After the render thread has stopped and the device is idle, before ImGui_ImplVulkan_Shutdown
+void imgui_destroy_textures(void);
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// Free ranges of a linear address space, kept sorted by offset
+typedef struct {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} MemoryRange;
+
+// First-fit free-list sub-allocator (used for device memory blocks and geometry pools)
+typedef struct {
+    VkDeviceSize capacity;
+    VkDeviceSize used;
+    MemoryRange* freeRanges;
+    uint32_t freeCount;
+    uint32_t freeCapacity;
+} RangeAllocator;
+
+void range_allocator_init(RangeAllocator* ra, VkDeviceSize capacity);
+void range_allocator_destroy(RangeAllocator* ra);
+VkBool32 range_allocator_alloc(RangeAllocator* ra, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+void range_allocator_free(RangeAllocator* ra, VkDeviceSize offset, VkDeviceSize size);
+VkDeviceSize range_allocator_largest_free(const RangeAllocator* ra);
+
+// Subsystem that owns an allocation, for per-tag usage statistics
+typedef enum {
+    MEMORY_TAG_GEOMETRY,
+    MEMORY_TAG_FONT,
+    MEMORY_TAG_IMGUI,
+    MEMORY_TAG_STAGING,
+    MEMORY_TAG_ATTACHMENT,
+    MEMORY_TAG_OTHER,
+    MEMORY_TAG_COUNT
+} MemoryTag;
+
+// Sub-allocation inside a large VkDeviceMemory block
+typedef struct {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+    uint32_t blockIndex;
+    MemoryTag tag;
+    void* mapped; // CPU pointer at offset when the block is host visible, NULL otherwise
+} MemoryAllocation;
+
+// Snapshot returned by memory_get_stats, cheap enough to poll every frame
+typedef struct {
+    uint32_t heapCount;
+    VkDeviceSize heapSize[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapBudget[VK_MAX_MEMORY_HEAPS]; // From VK_EXT_memory_budget, else 80% of heap size
+    VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS];  // Process-wide when budget is supported, else our blocks only
+    VkDeviceSize blockBytes[VK_MAX_MEMORY_HEAPS]; // VkDeviceMemory owned by this allocator
+    VkDeviceSize allocatedBytes[VK_MAX_MEMORY_HEAPS]; // Sub-allocated out of those blocks
+    VkDeviceSize tagBytes[MEMORY_TAG_COUNT];
+    uint32_t tagAllocations[MEMORY_TAG_COUNT];
+    uint32_t blockCount;
+    uint32_t allocationCount;
+    VkBool32 budgetSupported;
+    VkBool32 overBudget; // Some heap is above its budget
+} MemoryStats;
+
+#define MEMORY_BENCHMARK_ALLOCATIONS 1024
+#define MEMORY_BENCHMARK_SIZE (64 * 1024) // A typical small buffer
+#define MEMORY_BENCHMARK_RUNS 3 // Best run kept; the first one pays for creating blocks
+
+// ns per allocate + free pair of MEMORY_BENCHMARK_SIZE bytes
+typedef struct {
+    uint32_t allocationCount;
+    uint32_t deviceCount;     // Fewer when maxMemoryAllocationCount leaves no room for all of them
+    double rangeNs;           // range_allocator_alloc/free on its own
+    double subAllocateNs;     // memory_allocate/memory_free, device-local
+    double deviceNs;          // vkAllocateMemory/vkFreeMemory per allocation, the path before pooling
+} MemoryBenchmark;
+
+void init_memory(void);
+void cleanup_memory(void);
+void memory_allocate(const VkMemoryRequirements* requirements, VkMemoryPropertyFlags properties, MemoryTag tag, MemoryAllocation* allocation);
+void memory_free(MemoryAllocation* allocation);
+
+// Buffer helpers: create + sub-allocate + bind in one call
+void memory_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryTag tag, VkBuffer* buffer, MemoryAllocation* allocation);
+void memory_destroy_buffer(VkBuffer* buffer, MemoryAllocation* allocation);
+
+// Give empty cached blocks back to the driver, returns the bytes released
+VkDeviceSize memory_trim(void);
+
+// Budget tracking
+VkBool32 memory_heap_has_headroom(uint32_t heapIndex);
+void memory_get_stats(MemoryStats* stats);
+const char* memory_tag_name(MemoryTag tag);
+
+// Time the same allocate/free pattern through the range allocator, the pooled path and raw
+// vkAllocateMemory. Frees every other allocation first so the free list has to coalesce.
+// Creates and releases its own blocks, so run it before any frame is in flight.
+void memory_benchmark(MemoryBenchmark* result);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <vulkan/vulkan.h>
+
+#define PACER_SAFETY_MARGIN_NS 2000000ull // Slack for GPU work and compositing on top of the CPU estimate
+#define PACER_HISTORY 16 // Frames tracked for latency, must exceed the present queue depth
+
+typedef struct {
+    VkBool32 enabled;
+    VkBool32 presentWait;   // Deadlines come from VK_KHR_present_wait, else from the refresh rate
+    double refreshMs;
+    double cpuFrameMs;      // Input sampling to submit
+    double sleptMs;         // Delay inserted before the last input sample
+    double oversleepMs;     // Calibrated SDL_DelayNS overshoot
+    double latencyMs;       // Input sampling to display (present wait) or to GPU completion
+    double averageLatencyMs; // Since pacing was last toggled
+    uint64_t latencyFrame;
+} PacerStats;
+
+void init_pacer(SDL_Window* window);
+void pacer_set_enabled(VkBool32 enabled);
+// Call before input is sampled; when enabled, sleeps until just before the next frame is due
+void pacer_wait(void);
+// Call after vulkan_end_frame
+void pacer_frame_submitted(void);
+void pacer_get_stats(PacerStats* stats);
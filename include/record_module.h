@@ -0,0 +1,68 @@
+#pragma once
+
+#include "vulkan_module.h"
+#include "encoder_module.h"
+
+#define RECORD_MAX_WORKERS 16 // Recording threads, the render thread counts as worker 0
+#define RECORD_MAX_JOBS 256   // Secondary command buffers per frame
+#define RECORD_MIN_DRAWS_PER_JOB 64 // Below this a secondary costs more than it saves
+#define RECORD_CACHE_VERSIONS (MAX_FRAMES_IN_FLIGHT + 1) // Re-recording never waits on a frame still using the old one
+#define RECORD_CACHE_KEY_SIZE 64
+
+// Records `count` items starting at `first` into a secondary that already has the render pass,
+// viewport/scissor over the pass's render area and the geometry pools bound. Runs on any worker thread.
+typedef void (*RecordJobFunc)(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count);
+
+typedef struct {
+    uint32_t workerCount;   // Threads available, including the render thread
+    uint32_t activeWorkers; // Threads used for recording
+    uint32_t lastJobs;      // Secondaries executed last frame, over all its render passes
+    double lastRecordMs;    // Wall time of last frame's parallel recording
+} RecordStats;
+
+// Per thread count, recording the same draws into secondaries without submitting them
+typedef struct {
+    uint32_t drawCount;
+    uint32_t threadCount; // Entries in ms
+    double ms[RECORD_MAX_WORKERS];
+} RecordBenchmark;
+
+// Secondary recorded once and replayed every frame until its key (the inputs it was recorded
+// from) changes. Replaced versions stay valid until the frames that executed them complete.
+typedef struct {
+    VkCommandPool pool;
+    VkCommandBuffer buffers[RECORD_CACHE_VERSIONS];
+    uint64_t lastUsedFrame[RECORD_CACHE_VERSIONS];
+    unsigned char key[RECORD_CACHE_KEY_SIZE];
+    size_t keySize;
+    uint32_t current;
+    VkBool32 valid;
+    uint32_t recordCount; // Times recorded since record_cache_init
+    double lastRecordMs;
+} RecordCache;
+
+void init_record(void);
+void cleanup_record(void);
+void record_frame_begin(uint32_t frameIndex); // Call once the slot's previous frame has completed
+void record_set_workers(uint32_t count);
+
+// Queue work for record_execute; record_add_split cuts `total` items into per-worker batches
+void record_add_job(RecordJobFunc func, void* userData, uint32_t first, uint32_t count);
+void record_add_split(RecordJobFunc func, void* userData, uint32_t total);
+// Record every queued job on the worker pool, then execute the secondaries in queue order.
+// The render pass must have been begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+// Leaves the primary's encoder invalidated.
+void record_execute(CommandEncoder* encoder, VkFramebuffer framebuffer, VkExtent2D extent);
+// Splice an already recorded secondary (e.g. from record_cache_get) into the queue
+void record_add_secondary(VkCommandBuffer commandBuffer);
+
+void record_cache_init(RecordCache* cache);
+void record_cache_destroy(RecordCache* cache); // Waits for the frames that may still execute it
+// The cached secondary for `key`, re-recorded on the calling thread through func when the key changed.
+// The key must cover `extent`. Call once per frame that executes it, between vulkan_acquire_frame
+// and vulkan_end_frame.
+VkCommandBuffer record_cache_get(RecordCache* cache, VkExtent2D extent, const void* key, size_t keySize, RecordJobFunc func, void* userData, uint32_t count);
+
+// Waits for the GPU, then times recording `drawCount` items at 1..workerCount threads
+void record_benchmark(RecordJobFunc func, void* userData, uint32_t drawCount, RecordBenchmark* result);
+void record_get_stats(RecordStats* stats);
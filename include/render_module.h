@@ -0,0 +1,90 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "vulkan_module.h"
+#include "imgui_module.h"
+#include "pacer_module.h"
+#include "geometry_module.h"
+#include "record_module.h"
+#include "graph_module.h"
+#include "cull_module.h"
+
+// Render thread: owns recording, submission and presentation once started. The main thread
+// only handles events and builds the UI, and talks to it through two lock-free mailboxes.
+// After render_thread_start, Vulkan, upload, geometry, defer and memory calls belong to the
+// render thread until render_thread_stop returns.
+
+#define RENDER_MAILBOX_SLOTS 3 // Triple buffer: one slot written, one read, one handed over
+#define RENDER_BENCHMARK_DRAWS 20000 // Recording benchmark size when no grid is shown
+#define RENDER_CHURN_MESHES 64 // Meshes the geometry churn load cycles through
+#define RENDER_CHURN_MAX_VERTICES 65536 // 1.5 MB of vertices, more than one defrag step copies
+
+// One UI frame. Commands from the UI travel as state (values and counters) rather than as
+// events, so a snapshot the render thread never sees cannot lose one: it diffs against the
+// last snapshot it applied.
+typedef struct {
+    ImGuiSnapshot imgui;
+    uint64_t inputNs;     // When input for this frame was sampled, latency is measured from here
+    VkBool32 visible;     // VK_FALSE parks the render thread until a visible snapshot arrives
+    VkBool32 showTriangle;
+    VkBool32 showQuad;
+    VkBool32 lowLatency;
+    VkBool32 onDemand;    // Never re-present a stale snapshot, park until the next one instead
+    VkPresentModeKHR presentMode;
+    uint32_t bufferedImages;
+    VkBool32 parallelRecording; // Record into secondaries on the worker pool
+    VkBool32 cacheStatic;   // Replay the triangle, quad and grid from a cached secondary
+    uint32_t recordWorkers;
+    uint32_t gridDraws;     // Extra triangles for recording load, see render_triangle_grid
+    uint32_t quadInstances; // Instanced quads drawn over the scene in one call
+    uint32_t meshChurn;     // Meshes destroyed and recreated per frame, 0 frees the churn set
+    VkBool32 gpuCulling;    // Cull the quads in a compute pass and draw them indirectly
+    float cullRegion;       // Half-size of the clip-space square the GPU keeps quads in
+    float renderScale;      // Scene resolution relative to the window, the UI stays at full size
+    uint32_t resizeSerial; // Bumped for every resize, recreates the swapchain
+    uint32_t defragSerial; // Bumped for every Defragment click
+    uint32_t benchmarkSerial; // Bumped to run record_benchmark
+} FrameSnapshot;
+
+// Render-side state for the UI, which must not read the Vulkan modules directly
+typedef struct {
+    uint64_t submittedFrame;
+    uint64_t completedFrame;
+    VkBool32 timelineSupported;
+    VkPresentModeKHR presentMode;
+    uint32_t bufferedImages;
+    uint32_t imageCount;
+    uint32_t width;
+    uint32_t height;
+    uint32_t presentModeCount;
+    VkPresentModeKHR presentModes[MAX_PRESENT_MODES];
+    FrameLatency presentLatency[MAX_PRESENT_MODES][MAX_BUFFERED_IMAGES - MIN_BUFFERED_IMAGES + 1];
+    PacerStats pacer;
+    MemoryStats memory;
+    GeometryStats geometry;
+    uint32_t deferPending;
+    VkBool32 animating;    // Some module needs more frames to settle (defrag, deferred destroys)
+    RecordStats record;
+    RecordBenchmark benchmark; // threadCount is 0 until a benchmark has run
+    ThreadArenaStats arena; // The render thread's own arenas
+    GraphStats graph;
+    EncoderStats encoder;   // Binds issued and elided last frame
+    CullStats cull;
+    VkBool32 scaledRenderSupported; // renderScale below 1 is ignored without it
+    uint32_t staticRecords; // Times the cached static secondary has been (re)recorded
+    double staticRecordMs;  // Cost of the last re-record
+    double recordMs;       // Last frame's CPU time from begin_frame to end_frame
+    double stallMs;        // Last frame's time blocked in acquire and present
+    uint64_t staleFrames;  // Frames re-presented because the UI had not published in time
+    uint32_t imguiTextureSerial; // Last ImGui texture request applied; the main thread frees up to here
+} RenderStats;
+
+void render_thread_start(SDL_Window* window);
+void render_thread_stop(void); // Joins the thread and frees the snapshots
+
+// Pushed to the SDL queue when the render thread is ready for the next snapshot
+Uint32 render_ready_event(void);
+// Main thread: fill the returned slot, then publish it. Neither call blocks.
+FrameSnapshot* render_snapshot_begin(void);
+void render_snapshot_publish(void);
+void render_get_stats(RenderStats* stats);
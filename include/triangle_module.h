@@ -1,10 +1,39 @@
 #pragma once
 
 #include "vulkan_module.h"
+#include "encoder_module.h"
+#include "upload_module.h"
+#include "geometry_module.h"
 
 // Create vertex buffer for a triangle
 void create_triangle(void);
 // Render the triangle
-void render_triangle(VkCommandBuffer commandBuffer);
+void render_triangle(CommandEncoder* encoder);
 void create_quad(void);        // Create quad vertex buffer
-void render_quad(VkCommandBuffer commandBuffer); // Render quad
\ No newline at end of file
+void render_quad(CommandEncoder* encoder); // Render quad
+
+// Per-instance attributes of the instanced quad pipeline, read from binding 1
+typedef struct {
+    float offset[2];  // Clip-space center
+    float scale[2];   // Of the unit quad
+    uint8_t color[4]; // RGBA8 unorm, tints the quad
+    float rotation;   // Radians
+} QuadInstance;       // 24 bytes, so a million fit in one frame's upload ring
+
+// Unit quads, one draw call for all of them. Copies into this frame's upload ring, render thread only.
+void render_quad_instances(CommandEncoder* encoder, const QuadInstance* instances, uint32_t count);
+VkBool32 upload_quad_instances(const QuadInstance* instances, uint32_t count, FrameAllocation* allocation);
+// Draws instances that are already in a vertex buffer, safe on record workers
+void render_quad_instance_buffer(CommandEncoder* encoder, VkBuffer buffer, VkDeviceSize offset, uint32_t count);
+// Centered unit quad the instanced paths draw, for building indirect commands
+const MeshHandle* quad_instance_mesh(void);
+// Small tinted, rotated quads tiling clip space, for the instancing stress test
+void fill_quad_instance_grid(QuadInstance* instances, uint32_t count);
+// Grid of triangles tiling the render area, for recording load
+typedef struct {
+    uint32_t count;
+    VkExtent2D extent;
+} TriangleGrid;
+
+// Draws first..first+count of the (const TriangleGrid*)userData grid, as a RecordJobFunc
+void render_triangle_grid(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "vulkan_module.h"
+
+#define UPLOAD_STAGING_SIZE (8 * 1024 * 1024) // Staging ring size, larger batches flush in chunks
+#define UPLOAD_BATCH_SIZE (UPLOAD_STAGING_SIZE / 4) // Large uploads are submitted in pieces of this size
+#define UPLOAD_MAX_BATCHES 4 // Submitted batches in flight at once, each with its own command buffer and fence
+#define UPLOAD_FRAME_RING_SIZE (32 * 1024 * 1024) // Per-frame dynamic data budget
+
+// Transient per-frame allocation, valid until the same frame slot comes around again
+typedef struct {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void* data;
+} FrameAllocation;
+
+void init_upload(void);
+void cleanup_upload(void);
+
+// Queue a copy into dst; copies are batched until upload_flush
+void upload_buffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+// Submit every pending copy on the transfer queue without waiting
+void upload_flush(void);
+// Block until the last submitted batch has finished
+void upload_wait(void);
+// Record the graphics-side ownership acquire for submitted batches; returns VK_TRUE and the
+// semaphore the frame's submit must wait on when there is something to acquire
+VkBool32 upload_acquire(VkCommandBuffer commandBuffer, VkSemaphore* waitSemaphore);
+
+// Create a buffer for static data: DEVICE_LOCAL + staging copy, or direct write on UMA devices
+void upload_create_buffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, MemoryTag tag, VkBuffer* buffer, MemoryAllocation* allocation);
+
+// Per-frame upload ring for dynamic vertex/index data
+void upload_frame_ring_resize(uint32_t frameCount);
+void upload_frame_begin(uint32_t frameIndex); // Call once the slot's previous frame has completed
+VkBool32 upload_frame_alloc(VkDeviceSize size, VkDeviceSize alignment, FrameAllocation* allocation);
@@ -3,34 +3,71 @@
 #include <vulkan/vulkan.h>
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
+#include "memory_module.h"
+#include "alloc_module.h"
+#include "arena_module.h"
+
+#define MAX_SWAPCHAIN_IMAGES 8 // Fixed capacity so swapchain recreation never touches the heap
+#define MAX_FRAMES_IN_FLIGHT 2 // CPU may record this many frames ahead of the GPU; lower = less latency
+#define MAX_PRESENT_MODES 8
+#define MIN_BUFFERED_IMAGES 2 // Double buffering
+#define MAX_BUFFERED_IMAGES 3 // Triple buffering
+
+// Input-to-GPU-completion latency, accumulated per present mode
+typedef struct {
+    double lastMs;
+    double averageMs; // Mean over every frame rendered in this mode
+    uint64_t samples;
+} FrameLatency;
 
 typedef struct {
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceMemoryProperties memoryProperties; // Cached at init_vulkan
+    VkBool32 memoryBudgetSupported; // VK_EXT_memory_budget enabled
+    VkBool32 timelineSupported; // VK_KHR_timeline_semaphore enabled, frames signal frameTimeline instead of fences
+    VkBool32 presentWaitSupported; // VK_KHR_present_id + VK_KHR_present_wait enabled, presents carry the frame number
     VkDevice device;
     VkQueue graphicsQueue;
+    uint32_t graphicsFamily;
+    VkQueue transferQueue; // Dedicated transfer family when available, else graphicsQueue
+    uint32_t transferFamily;
+    SDL_Mutex* queueLock; // VkQueue access is externally synchronized; held around every submit
     VkSurfaceKHR surface;
     VkSwapchainKHR swapchain;
-    VkRenderPass renderPass;
+    VkSurfaceFormatKHR surfaceFormat; // Picked from what the surface reports, fixed for the render pass
+    uint32_t bufferedImages; // Requested swapchain depth, MIN_BUFFERED_IMAGES..MAX_BUFFERED_IMAGES
+    VkPresentModeKHR presentMode;
+    VkPresentModeKHR presentModes[MAX_PRESENT_MODES]; // Supported by the surface
+    // Parallel to presentModes, one column per buffering depth so double and triple can be compared
+    FrameLatency presentLatency[MAX_PRESENT_MODES][MAX_BUFFERED_IMAGES - MIN_BUFFERED_IMAGES + 1];
+    uint32_t presentModeCount;
+    VkRenderPass renderPass; // Pipelines and secondaries are built against it; the graph begins compatible ones
     VkPipelineLayout pipelineLayout;
     VkPipeline graphicsPipeline;
+    VkPipeline instancedPipeline; // Same state, plus QuadInstance attributes at binding 1
     VkCommandPool commandPool;
     // VkCommandBuffer commandBuffer;
-    VkCommandBuffer* commandBuffers; // Array of command buffers
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexMemory;
-    VkBuffer quadBuffer;
-    VkDeviceMemory quadMemory;
-    VkBuffer quadIndexBuffer;
-    VkDeviceMemory quadIndexMemory;
-    VkSemaphore* imageAvailableSemaphores;
-    VkSemaphore* renderFinishedSemaphores;
-    VkFence* inFlightFences;
+    // Per frame in flight
+    VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+    VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
+    VkFence inFlightFences[MAX_FRAMES_IN_FLIGHT]; // Fence mode only
+    uint64_t frameValues[MAX_FRAMES_IN_FLIGHT]; // Frame number last submitted from each slot
+    uint64_t frameStartTimes[MAX_FRAMES_IN_FLIGHT]; // vulkan_frame_start time of that frame, in ns
+    uint64_t frameStartNs;
+    uint32_t currentFrame;
+    // Frame timeline: frame N signals value N, see vulkan_frame_completed
+    VkSemaphore frameTimeline; // Timeline mode only
+    uint64_t submittedFrame;
+    uint64_t completedFrame; // Cached lower bound, refreshed by vulkan_frame_completed
+    // Per swapchain image
+    VkSemaphore renderFinishedSemaphores[MAX_SWAPCHAIN_IMAGES];
+    uint64_t imagesInFlight[MAX_SWAPCHAIN_IMAGES]; // Frame that last rendered the image, 0 if none
     uint32_t imageCount;
-    VkImage* swapchainImages;
-    VkImageView* swapchainImageViews;
-    VkFramebuffer* swapchainFramebuffers;
+    VkImage swapchainImages[MAX_SWAPCHAIN_IMAGES];
+    VkImageView swapchainImageViews[MAX_SWAPCHAIN_IMAGES];
+    VkBool32 scaledRenderSupported; // Swapchain images can be blit targets, so the scene can render below window size
     VkDescriptorPool imguiDescriptorPool;
     uint32_t width;
     uint32_t height;
@@ -45,5 +82,22 @@ uint32_t find_memory_type(VulkanContext* ctx, uint32_t typeFilter, VkMemoryPrope
 
 // render handle
 void recreate_swapchain(SDL_Window* window);
-void vulkan_begin_render(uint32_t imageIndex);
-void vulkan_end_render(uint32_t imageIndex, uint32_t semaphoreIndex);
\ No newline at end of file
+VkResult vulkan_acquire_frame(uint32_t* imageIndex);
+// Begins the frame's command buffer outside any render pass; passes are recorded through the graph
+struct CommandEncoder* vulkan_begin_frame(void);
+VkResult vulkan_end_frame(uint32_t imageIndex);
+
+// Frame timeline shared by every subsystem: frames are numbered from 1 in submit order
+uint64_t vulkan_frame_submitted(void); // Last frame handed to the graphics queue
+uint64_t vulkan_frame_completed(void); // Every frame up to and including this one has finished on the GPU
+void vulkan_wait_frame(uint64_t frame);
+
+// Present mode switching; returns VK_TRUE when the swapchain must be recreated to apply it
+VkBool32 vulkan_set_present_mode(VkPresentModeKHR mode);
+VkBool32 vulkan_set_buffered_images(uint32_t count); // Same contract, 2 = double, 3 = triple buffering
+const char* vulkan_present_mode_name(VkPresentModeKHR mode);
+// Latency is measured from here (call before polling input) until the GPU finishes the frame
+void vulkan_frame_start(void);
+// Serializes queue submission between the render thread and main-thread texture uploads
+void vulkan_lock_queue(void);
+void vulkan_unlock_queue(void);
\ No newline at end of file
@@ -7,6 +7,7 @@ echo path "%VULKAN_Path%"
 
 %VULKAN_Path% -V --vn triangle_vert_spv assets/triangle.vert -o include/triangle_vert.h
 %VULKAN_Path% -V --vn triangle_frag_spv assets/triangle.frag -o include/triangle_frag.h
+@REM quad_instanced.vert and quad_cull.comp are compiled by CMake into build/generated/
 
 %VULKAN_Path% -V assets/minimal.vert -o build/minimal_vert.spv
 %VULKAN_Path% -V assets/minimal.frag -o build/minimal_frag.spv
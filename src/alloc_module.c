@@ -0,0 +1,187 @@
+#include "alloc_module.h"
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Stored in front of every block so frees know their size and bucket
+typedef struct {
+    void* base; // Pointer returned by malloc
+    size_t size;
+    uint32_t object;
+    uint32_t scope;
+} AllocHeader;
+
+typedef struct {
+    VkAllocationCallbacks callbacks[ALLOC_OBJECT_COUNT];
+    AllocStats stats;
+    SDL_SpinLock lock; // Drivers may call back from their own threads
+    uint64_t lastDump;
+    VkBool32 initialized;
+} AllocContext;
+
+static AllocContext allocCtx = {0};
+
+static const char* object_names[ALLOC_OBJECT_COUNT] = {
+    "instance", "device", "surface", "swapchain", "image view", "framebuffer", "render pass", "pipeline",
+    "shader module", "command pool", "sync", "buffer", "image", "memory", "descriptor", "debug", "imgui"
+};
+
+static const char* scope_names[ALLOC_SCOPE_COUNT] = {"command", "object", "cache", "device", "instance"};
+
+static void count_alloc(AllocCounters* counters, size_t size) {
+    counters->allocations++;
+    counters->liveBytes += size;
+    counters->totalBytes += size;
+    if (counters->liveBytes > counters->peakBytes) {
+        counters->peakBytes = counters->liveBytes;
+    }
+}
+
+static void count_free(AllocCounters* counters, size_t size) {
+    counters->frees++;
+    counters->liveBytes -= size;
+}
+
+static void track(uint32_t object, uint32_t scope, size_t size, VkBool32 allocated) {
+    SDL_LockSpinlock(&allocCtx.lock);
+    AllocCounters* buckets[] = {&allocCtx.stats.objects[object], &allocCtx.stats.scopes[scope], &allocCtx.stats.total};
+    for (uint32_t i = 0; i < 3; i++) {
+        if (allocated) count_alloc(buckets[i], size);
+        else count_free(buckets[i], size);
+    }
+    SDL_UnlockSpinlock(&allocCtx.lock);
+}
+
+static AllocHeader* header_of(void* memory) {
+    return (AllocHeader*)memory - 1;
+}
+
+static void* VKAPI_PTR tracked_alloc(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (alignment < 16) {
+        alignment = 16;
+    }
+    // Room for the header plus worst-case alignment padding
+    char* base = malloc(size + alignment + sizeof(AllocHeader));
+    if (!base) {
+        return NULL;
+    }
+    uintptr_t aligned = ((uintptr_t)base + sizeof(AllocHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    AllocHeader* header = header_of((void*)aligned);
+    header->base = base;
+    header->size = size;
+    header->object = (uint32_t)(uintptr_t)userData;
+    header->scope = (uint32_t)scope;
+    track(header->object, header->scope, size, VK_TRUE);
+    return (void*)aligned;
+}
+
+static void VKAPI_PTR tracked_free(void* userData, void* memory) {
+    if (!memory) {
+        return;
+    }
+    AllocHeader* header = header_of(memory);
+    track(header->object, header->scope, header->size, VK_FALSE);
+    free(header->base);
+}
+
+static void* VKAPI_PTR tracked_realloc(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (!original) {
+        return tracked_alloc(userData, size, alignment, scope);
+    }
+    if (size == 0) {
+        tracked_free(userData, original);
+        return NULL;
+    }
+    void* memory = tracked_alloc(userData, size, alignment, scope);
+    if (memory) {
+        size_t oldSize = header_of(original)->size;
+        memcpy(memory, original, oldSize < size ? oldSize : size);
+        tracked_free(userData, original);
+    }
+    return memory;
+}
+
+static void VKAPI_PTR internal_alloc(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+    SDL_LockSpinlock(&allocCtx.lock);
+    allocCtx.stats.objects[(uintptr_t)userData].internalBytes += size;
+    allocCtx.stats.scopes[scope].internalBytes += size;
+    allocCtx.stats.total.internalBytes += size;
+    SDL_UnlockSpinlock(&allocCtx.lock);
+}
+
+static void VKAPI_PTR internal_free(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+    SDL_LockSpinlock(&allocCtx.lock);
+    allocCtx.stats.objects[(uintptr_t)userData].internalBytes -= size;
+    allocCtx.stats.scopes[scope].internalBytes -= size;
+    allocCtx.stats.total.internalBytes -= size;
+    SDL_UnlockSpinlock(&allocCtx.lock);
+}
+
+const VkAllocationCallbacks* vk_allocator(AllocObjectType type) {
+#ifdef VK_ALLOC_TRACKING
+    if (!allocCtx.initialized) {
+        // pUserData carries the object type into the callbacks
+        for (uint32_t i = 0; i < ALLOC_OBJECT_COUNT; i++) {
+            VkAllocationCallbacks* callbacks = &allocCtx.callbacks[i];
+            callbacks->pUserData = (void*)(uintptr_t)i;
+            callbacks->pfnAllocation = tracked_alloc;
+            callbacks->pfnReallocation = tracked_realloc;
+            callbacks->pfnFree = tracked_free;
+            callbacks->pfnInternalAllocation = internal_alloc;
+            callbacks->pfnInternalFree = internal_free;
+        }
+        allocCtx.stats.enabled = VK_TRUE;
+        allocCtx.lastDump = SDL_GetTicks();
+        allocCtx.initialized = VK_TRUE;
+    }
+    return &allocCtx.callbacks[type];
+#else
+    (void)type;
+    return NULL;
+#endif
+}
+
+void alloc_get_stats(AllocStats* stats) {
+    SDL_LockSpinlock(&allocCtx.lock);
+    *stats = allocCtx.stats;
+    SDL_UnlockSpinlock(&allocCtx.lock);
+}
+
+static void print_counters(const char* name, const AllocCounters* counters) {
+    if (counters->allocations == 0 && counters->internalBytes == 0) {
+        return;
+    }
+    printf("  %-14s %8llu allocs %8llu frees %10llu live %10llu peak %12llu total %8llu internal\n", name,
+           (unsigned long long)counters->allocations, (unsigned long long)counters->frees,
+           (unsigned long long)counters->liveBytes, (unsigned long long)counters->peakBytes,
+           (unsigned long long)counters->totalBytes, (unsigned long long)counters->internalBytes);
+}
+
+void alloc_dump(void) {
+    AllocStats stats;
+    alloc_get_stats(&stats);
+    if (!stats.enabled) {
+        return;
+    }
+    printf("Vulkan host allocations by object type:\n");
+    for (uint32_t i = 0; i < ALLOC_OBJECT_COUNT; i++) {
+        print_counters(object_names[i], &stats.objects[i]);
+    }
+    printf("By scope:\n");
+    for (uint32_t i = 0; i < ALLOC_SCOPE_COUNT; i++) {
+        print_counters(scope_names[i], &stats.scopes[i]);
+    }
+    print_counters("total", &stats.total);
+}
+
+void alloc_tick(void) {
+    if (!allocCtx.initialized) {
+        return;
+    }
+    uint64_t now = SDL_GetTicks();
+    if (now - allocCtx.lastDump >= ALLOC_DUMP_INTERVAL_MS) {
+        allocCtx.lastDump = now;
+        alloc_dump();
+    }
+}
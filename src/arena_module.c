@@ -0,0 +1,230 @@
+#include "arena_module.h"
+#include "alloc_module.h"
+#include "cimgui.h"
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Each arena is only backed once its thread first allocates from it
+typedef struct {
+    Arena frame;
+    Arena scratch;
+    uint32_t scratchDepth; // Open scratch_begin scopes on this thread
+} ThreadArenas;
+
+typedef struct {
+    SDL_TLSID threadArenas; // ThreadArenas* of the calling thread
+    SDL_AtomicInt heapAllocations; // Counts every heap allocation, from any thread
+    uint32_t frameStartCount;
+    uint64_t frameStartVulkan;
+    uint32_t lastFrameHeapAllocations;
+    uint32_t steadyFrames;
+    uint64_t totalHeapAllocations;
+
+    // Originals wrapped by the SDL hooks
+    SDL_malloc_func sdlMalloc;
+    SDL_calloc_func sdlCalloc;
+    SDL_realloc_func sdlRealloc;
+    SDL_free_func sdlFree;
+} ArenaContext;
+
+static ArenaContext arenaCtx = {0};
+
+//================================================
+// Arena
+//================================================
+
+void arena_init(Arena* arena, size_t capacity) {
+    arena->base = heap_alloc(capacity);
+    arena->capacity = capacity;
+    arena->head = 0;
+    arena->peak = 0;
+}
+
+void arena_destroy(Arena* arena) {
+    heap_free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment) {
+    size_t offset = (arena->head + alignment - 1) & ~(alignment - 1);
+    if (offset + size > arena->capacity) {
+        printf("Arena exhausted (%zu of %zu bytes used, %zu requested)\n", arena->head, arena->capacity, size);
+        exit(1);
+    }
+    arena->head = offset + size;
+    if (arena->head > arena->peak) {
+        arena->peak = arena->head;
+    }
+    return arena->base + offset;
+}
+
+void arena_reset(Arena* arena) {
+    arena->head = 0;
+}
+
+//================================================
+// Heap counting
+//================================================
+
+void heap_count_allocation(void) {
+    SDL_AddAtomicInt(&arenaCtx.heapAllocations, 1);
+}
+
+void* heap_alloc(size_t size) {
+    heap_count_allocation();
+    return malloc(size);
+}
+
+void* heap_realloc(void* memory, size_t size) {
+    heap_count_allocation();
+    return realloc(memory, size);
+}
+
+void heap_free(void* memory) {
+    free(memory);
+}
+
+static void* SDLCALL sdl_malloc_hook(size_t size) {
+    heap_count_allocation();
+    return arenaCtx.sdlMalloc(size);
+}
+
+static void* SDLCALL sdl_calloc_hook(size_t count, size_t size) {
+    heap_count_allocation();
+    return arenaCtx.sdlCalloc(count, size);
+}
+
+static void* SDLCALL sdl_realloc_hook(void* memory, size_t size) {
+    heap_count_allocation();
+    return arenaCtx.sdlRealloc(memory, size);
+}
+
+static void SDLCALL sdl_free_hook(void* memory) {
+    arenaCtx.sdlFree(memory);
+}
+
+static void* imgui_alloc_hook(size_t size, void* userData) {
+    heap_count_allocation();
+    return malloc(size);
+}
+
+static void imgui_free_hook(void* memory, void* userData) {
+    free(memory);
+}
+
+//================================================
+// Frame and scratch arenas
+//================================================
+
+static void SDLCALL destroy_thread_arenas(void* value) {
+    ThreadArenas* arenas = value;
+    arena_destroy(&arenas->frame);
+    arena_destroy(&arenas->scratch);
+    heap_free(arenas);
+}
+
+static ThreadArenas* thread_arenas(void) {
+    ThreadArenas* arenas = SDL_GetTLS(&arenaCtx.threadArenas);
+    if (!arenas) {
+        arenas = heap_alloc(sizeof(ThreadArenas));
+        memset(arenas, 0, sizeof(*arenas));
+        if (!SDL_SetTLS(&arenaCtx.threadArenas, arenas, destroy_thread_arenas)) {
+            printf("Failed to set thread arenas: %s\n", SDL_GetError());
+            exit(1);
+        }
+    }
+    return arenas;
+}
+
+void init_arenas(void) {
+    memset(&arenaCtx, 0, sizeof(arenaCtx));
+
+    SDL_GetOriginalMemoryFunctions(&arenaCtx.sdlMalloc, &arenaCtx.sdlCalloc, &arenaCtx.sdlRealloc, &arenaCtx.sdlFree);
+    if (!SDL_SetMemoryFunctions(sdl_malloc_hook, sdl_calloc_hook, sdl_realloc_hook, sdl_free_hook)) {
+        printf("Failed to hook SDL memory functions: %s\n", SDL_GetError());
+    }
+    igSetAllocatorFunctions(imgui_alloc_hook, imgui_free_hook, NULL);
+}
+
+void cleanup_arenas(void) {
+    ThreadArenas* arenas = SDL_GetTLS(&arenaCtx.threadArenas);
+    if (arenas) {
+        SDL_SetTLS(&arenaCtx.threadArenas, NULL, NULL);
+        destroy_thread_arenas(arenas);
+    }
+}
+
+void arena_frame_begin(void) {
+    ThreadArenas* arenas = SDL_GetTLS(&arenaCtx.threadArenas);
+    if (!arenas) {
+        return;
+    }
+    arena_reset(&arenas->frame);
+    if (arenas->scratch.head != 0) {
+        printf("Scratch arena not released at frame end (%zu bytes)\n", arenas->scratch.head);
+        arena_reset(&arenas->scratch);
+        arenas->scratchDepth = 0;
+    }
+}
+
+void heap_frame_end(void) {
+    // Vulkan host allocations go through alloc_module, add them to the count
+    AllocStats allocStats;
+    alloc_get_stats(&allocStats);
+    uint32_t count = (uint32_t)SDL_GetAtomicInt(&arenaCtx.heapAllocations);
+    uint32_t frameCount = (count - arenaCtx.frameStartCount) + (uint32_t)(allocStats.total.allocations - arenaCtx.frameStartVulkan);
+    arenaCtx.frameStartCount = count;
+    arenaCtx.frameStartVulkan = allocStats.total.allocations;
+
+    arenaCtx.lastFrameHeapAllocations = frameCount;
+    arenaCtx.totalHeapAllocations += frameCount;
+    arenaCtx.steadyFrames = frameCount == 0 ? arenaCtx.steadyFrames + 1 : 0;
+}
+
+void* frame_alloc(size_t size) {
+    ThreadArenas* arenas = thread_arenas();
+    if (!arenas->frame.base) {
+        arena_init(&arenas->frame, FRAME_ARENA_SIZE);
+    }
+    return arena_alloc(&arenas->frame, size, 16);
+}
+
+ScratchScope scratch_begin(void) {
+    ThreadArenas* arenas = thread_arenas();
+    if (!arenas->scratch.base) {
+        arena_init(&arenas->scratch, SCRATCH_ARENA_SIZE);
+    }
+    arenas->scratchDepth++;
+    ScratchScope scope = {arenas->scratch.head};
+    return scope;
+}
+
+void* scratch_alloc(size_t size) {
+    ThreadArenas* arenas = thread_arenas();
+    // Without a scope nothing would ever release the memory, and this thread's arena may not exist yet
+    if (arenas->scratchDepth == 0) {
+        printf("scratch_alloc of %zu bytes outside a scratch_begin/scratch_end scope\n", size);
+        exit(1);
+    }
+    return arena_alloc(&arenas->scratch, size, 16);
+}
+
+void scratch_end(ScratchScope scope) {
+    ThreadArenas* arenas = thread_arenas();
+    arenas->scratchDepth--;
+    arenas->scratch.head = scope.mark;
+}
+
+void arena_get_stats(ArenaStats* stats) {
+    stats->lastFrameHeapAllocations = arenaCtx.lastFrameHeapAllocations;
+    stats->steadyFrames = arenaCtx.steadyFrames;
+    stats->totalHeapAllocations = arenaCtx.totalHeapAllocations;
+}
+
+void arena_get_thread_stats(ThreadArenaStats* stats) {
+    ThreadArenas* arenas = SDL_GetTLS(&arenaCtx.threadArenas);
+    stats->framePeak = arenas ? arenas->frame.peak : 0;
+    stats->scratchPeak = arenas ? arenas->scratch.peak : 0;
+}
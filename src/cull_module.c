@@ -0,0 +1,220 @@
+#include "cull_module.h"
+#include "upload_module.h"
+#include "defer_module.h"
+#include "quad_cull_comp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    float bounds[4];
+    uint32_t count;
+    uint32_t frame; // Which draw command the survivors are counted into
+} CullPushConstants;
+
+typedef struct {
+    VkDescriptorSetLayout setLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    VkDescriptorPool descriptorPool; // Holds the one set, recreated with the buffers it points at
+    VkDescriptorSet descriptorSet;
+    VkBuffer instanceBuffer; // Compute input, replaced by cull_set_instances
+    MemoryAllocation instanceMemory;
+    VkBuffer visibleBuffer;  // Compacted survivors, read as instance-rate vertices
+    MemoryAllocation visibleMemory;
+    uint32_t visibleCapacity;
+    // One VkDrawIndexedIndirectCommand per frame in flight, host visible so the count can be read
+    // back once the slot's frame has completed
+    VkBuffer drawBuffer;
+    MemoryAllocation drawMemory;
+    uint32_t count;
+    uint32_t frame;   // Slot whose draw command this frame's dispatch filled
+    uint32_t visible;
+} CullContext;
+
+static CullContext cullCtx = {0};
+
+void init_cull(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    memset(&cullCtx, 0, sizeof(cullCtx));
+
+    // Instances, survivors, draw commands
+    VkDescriptorSetLayoutBinding bindings[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        bindings[i] = (VkDescriptorSetLayoutBinding){i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL};
+    }
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    setLayoutInfo.bindingCount = 3;
+    setLayoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(vkCtx->device, &setLayoutInfo, vk_allocator(ALLOC_OBJECT_DESCRIPTOR), &cullCtx.setLayout) != VK_SUCCESS) {
+        printf("Failed to create cull descriptor set layout\n");
+        exit(1);
+    }
+
+    VkPushConstantRange pushRange = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants)};
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &cullCtx.setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+    if (vkCreatePipelineLayout(vkCtx->device, &pipelineLayoutInfo, vk_allocator(ALLOC_OBJECT_PIPELINE), &cullCtx.pipelineLayout) != VK_SUCCESS) {
+        printf("Failed to create cull pipeline layout\n");
+        exit(1);
+    }
+
+    VkShaderModuleCreateInfo shaderInfo = {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+    shaderInfo.codeSize = sizeof(quad_cull_comp_spv);
+    shaderInfo.pCode = quad_cull_comp_spv;
+    VkShaderModule computeModule;
+    if (vkCreateShaderModule(vkCtx->device, &shaderInfo, vk_allocator(ALLOC_OBJECT_SHADER_MODULE), &computeModule) != VK_SUCCESS) {
+        printf("Failed to create cull shader module\n");
+        exit(1);
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipelineInfo.stage = (VkPipelineShaderStageCreateInfo){VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, NULL, 0, VK_SHADER_STAGE_COMPUTE_BIT, computeModule, "main", NULL};
+    pipelineInfo.layout = cullCtx.pipelineLayout;
+    if (vkCreateComputePipelines(vkCtx->device, VK_NULL_HANDLE, 1, &pipelineInfo, vk_allocator(ALLOC_OBJECT_PIPELINE), &cullCtx.pipeline) != VK_SUCCESS) {
+        printf("Failed to create cull pipeline\n");
+        exit(1);
+    }
+    vkDestroyShaderModule(vkCtx->device, computeModule, vk_allocator(ALLOC_OBJECT_SHADER_MODULE));
+
+    memory_create_buffer(MAX_FRAMES_IN_FLIGHT * sizeof(VkDrawIndexedIndirectCommand),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_TAG_GEOMETRY,
+                         &cullCtx.drawBuffer, &cullCtx.drawMemory);
+    memset(cullCtx.drawMemory.mapped, 0, MAX_FRAMES_IN_FLIGHT * sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void cleanup_cull(void) {
+    // Device is idle; everything goes through the defer queue, flushed right after
+    vk_defer_destroy_buffer(&cullCtx.instanceBuffer, &cullCtx.instanceMemory);
+    vk_defer_destroy_buffer(&cullCtx.visibleBuffer, &cullCtx.visibleMemory);
+    vk_defer_destroy_buffer(&cullCtx.drawBuffer, &cullCtx.drawMemory);
+    vk_defer_destroy((uint64_t)cullCtx.descriptorPool, VK_OBJECT_TYPE_DESCRIPTOR_POOL);
+    vk_defer_destroy((uint64_t)cullCtx.pipeline, VK_OBJECT_TYPE_PIPELINE);
+    vk_defer_destroy((uint64_t)cullCtx.pipelineLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT);
+    vk_defer_destroy((uint64_t)cullCtx.setLayout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT);
+    memset(&cullCtx, 0, sizeof(cullCtx));
+}
+
+static void write_descriptor_set(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+
+    // Frames in flight may still use the old set, so it gets a fresh pool instead of an update
+    vk_defer_destroy((uint64_t)cullCtx.descriptorPool, VK_OBJECT_TYPE_DESCRIPTOR_POOL);
+    VkDescriptorPoolSize poolSize = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3};
+    VkDescriptorPoolCreateInfo poolInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(vkCtx->device, &poolInfo, vk_allocator(ALLOC_OBJECT_DESCRIPTOR), &cullCtx.descriptorPool) != VK_SUCCESS) {
+        printf("Failed to create cull descriptor pool\n");
+        exit(1);
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    allocInfo.descriptorPool = cullCtx.descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &cullCtx.setLayout;
+    if (vkAllocateDescriptorSets(vkCtx->device, &allocInfo, &cullCtx.descriptorSet) != VK_SUCCESS) {
+        printf("Failed to allocate cull descriptor set\n");
+        exit(1);
+    }
+
+    VkDescriptorBufferInfo bufferInfos[3] = {
+        {cullCtx.instanceBuffer, 0, VK_WHOLE_SIZE},
+        {cullCtx.visibleBuffer, 0, VK_WHOLE_SIZE},
+        {cullCtx.drawBuffer, 0, VK_WHOLE_SIZE}
+    };
+    VkWriteDescriptorSet writes[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        writes[i] = (VkWriteDescriptorSet){VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        writes[i].dstSet = cullCtx.descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(vkCtx->device, 3, writes, 0, NULL);
+}
+
+void cull_set_instances(const QuadInstance* instances, uint32_t count) {
+    vk_defer_destroy_buffer(&cullCtx.instanceBuffer, &cullCtx.instanceMemory);
+    cullCtx.count = count;
+    if (count == 0) {
+        return;
+    }
+
+    VkDeviceSize size = (VkDeviceSize)count * sizeof(QuadInstance);
+    upload_create_buffer(instances, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMORY_TAG_GEOMETRY,
+                         &cullCtx.instanceBuffer, &cullCtx.instanceMemory);
+    if (count > cullCtx.visibleCapacity) {
+        // Worst case every instance survives
+        vk_defer_destroy_buffer(&cullCtx.visibleBuffer, &cullCtx.visibleMemory);
+        memory_create_buffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_TAG_GEOMETRY,
+                             &cullCtx.visibleBuffer, &cullCtx.visibleMemory);
+        cullCtx.visibleCapacity = count;
+    }
+    write_descriptor_set();
+}
+
+void cull_dispatch(VkCommandBuffer commandBuffer, const float bounds[4]) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    cullCtx.frame = vkCtx->currentFrame;
+
+    // The slot's previous frame has completed, so its command holds the survivor count
+    VkDrawIndexedIndirectCommand* draw = (VkDrawIndexedIndirectCommand*)cullCtx.drawMemory.mapped + cullCtx.frame;
+    cullCtx.visible = draw->instanceCount;
+    if (cullCtx.count == 0) {
+        return;
+    }
+
+    // Written after begin_frame, so a defrag step that moved the quad this frame is already applied
+    const MeshHandle* mesh = quad_instance_mesh();
+    draw->indexCount = mesh->indexCount;
+    draw->instanceCount = 0; // The shader counts survivors into it
+    draw->firstIndex = mesh->firstIndex;
+    draw->vertexOffset = (int32_t)mesh->firstVertex;
+    draw->firstInstance = 0;
+
+    // The previous frame's draw may still be reading the survivors this dispatch overwrites
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, NULL, 0, NULL, 0, NULL);
+
+    CullPushConstants push;
+    memcpy(push.bounds, bounds, sizeof(push.bounds));
+    push.count = cullCtx.count;
+    push.frame = cullCtx.frame;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullCtx.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullCtx.pipelineLayout, 0, 1, &cullCtx.descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, cullCtx.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdDispatch(commandBuffer, (cullCtx.count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // Survivors and their count feed the draw, and the count is read back by the host later
+    VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void cull_draw(CommandEncoder* encoder) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (cullCtx.count == 0) {
+        return;
+    }
+    encoder_bind_pipeline(encoder, vkCtx->instancedPipeline);
+    encoder_bind_vertex_buffer(encoder, 1, cullCtx.visibleBuffer, 0);
+    geometry_bind_mesh(encoder, quad_instance_mesh()); // The command's offsets are relative to its blocks
+    encoder_draw_indexed_indirect(encoder, cullCtx.drawBuffer, cullCtx.frame * sizeof(VkDrawIndexedIndirectCommand),
+                                  1, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void cull_get_stats(CullStats* stats) {
+    stats->instances = cullCtx.count;
+    stats->visible = cullCtx.count > 0 ? cullCtx.visible : 0;
+}
@@ -0,0 +1,141 @@
+#include "defer_module.h"
+#include "vulkan_module.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    VkObjectType type;
+    uint64_t handle;
+    MemoryAllocation allocation; // Buffers and memory entries, released after the buffer
+    uint64_t retireFrame;
+} DeferredDestroy;
+
+typedef struct {
+    DeferredDestroy* entries; // Kept in queue order so dependents die before what they were built on
+    uint32_t count;
+    uint32_t capacity;
+} DeferContext;
+
+static DeferContext deferCtx = {0};
+
+static DeferredDestroy* push_entry(uint64_t handle, VkObjectType type) {
+    if (deferCtx.count == deferCtx.capacity) {
+        deferCtx.capacity = deferCtx.capacity ? deferCtx.capacity * 2 : 64;
+        deferCtx.entries = heap_realloc(deferCtx.entries, deferCtx.capacity * sizeof(DeferredDestroy));
+    }
+    DeferredDestroy* entry = &deferCtx.entries[deferCtx.count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->type = type;
+    entry->handle = handle;
+    entry->retireFrame = vulkan_frame_submitted() + 1; // The frame being recorded may still use it
+    return entry;
+}
+
+static void destroy_entry(DeferredDestroy* entry) {
+    VkDevice device = get_vulkan_context()->device;
+    switch (entry->type) {
+        case VK_OBJECT_TYPE_BUFFER:
+            vkDestroyBuffer(device, (VkBuffer)entry->handle, vk_allocator(ALLOC_OBJECT_BUFFER));
+            memory_free(&entry->allocation);
+            break;
+        case VK_OBJECT_TYPE_DEVICE_MEMORY:
+            memory_free(&entry->allocation);
+            break;
+        case VK_OBJECT_TYPE_IMAGE:
+            vkDestroyImage(device, (VkImage)entry->handle, vk_allocator(ALLOC_OBJECT_IMAGE));
+            break;
+        case VK_OBJECT_TYPE_SAMPLER:
+            vkDestroySampler(device, (VkSampler)entry->handle, vk_allocator(ALLOC_OBJECT_IMAGE));
+            break;
+        case VK_OBJECT_TYPE_IMAGE_VIEW:
+            vkDestroyImageView(device, (VkImageView)entry->handle, vk_allocator(ALLOC_OBJECT_IMAGE_VIEW));
+            break;
+        case VK_OBJECT_TYPE_FRAMEBUFFER:
+            vkDestroyFramebuffer(device, (VkFramebuffer)entry->handle, vk_allocator(ALLOC_OBJECT_FRAMEBUFFER));
+            break;
+        case VK_OBJECT_TYPE_RENDER_PASS:
+            vkDestroyRenderPass(device, (VkRenderPass)entry->handle, vk_allocator(ALLOC_OBJECT_RENDER_PASS));
+            break;
+        case VK_OBJECT_TYPE_PIPELINE:
+            vkDestroyPipeline(device, (VkPipeline)entry->handle, vk_allocator(ALLOC_OBJECT_PIPELINE));
+            break;
+        case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+            vkDestroyPipelineLayout(device, (VkPipelineLayout)entry->handle, vk_allocator(ALLOC_OBJECT_PIPELINE));
+            break;
+        case VK_OBJECT_TYPE_SHADER_MODULE:
+            vkDestroyShaderModule(device, (VkShaderModule)entry->handle, vk_allocator(ALLOC_OBJECT_SHADER_MODULE));
+            break;
+        case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+            vkDestroyDescriptorPool(device, (VkDescriptorPool)entry->handle, vk_allocator(ALLOC_OBJECT_DESCRIPTOR));
+            break;
+        case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT:
+            vkDestroyDescriptorSetLayout(device, (VkDescriptorSetLayout)entry->handle, vk_allocator(ALLOC_OBJECT_DESCRIPTOR));
+            break;
+        case VK_OBJECT_TYPE_SEMAPHORE:
+            vkDestroySemaphore(device, (VkSemaphore)entry->handle, vk_allocator(ALLOC_OBJECT_SYNC));
+            break;
+        case VK_OBJECT_TYPE_FENCE:
+            vkDestroyFence(device, (VkFence)entry->handle, vk_allocator(ALLOC_OBJECT_SYNC));
+            break;
+        case VK_OBJECT_TYPE_COMMAND_POOL:
+            vkDestroyCommandPool(device, (VkCommandPool)entry->handle, vk_allocator(ALLOC_OBJECT_COMMAND_POOL));
+            break;
+        case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+            vkDestroySwapchainKHR(device, (VkSwapchainKHR)entry->handle, vk_allocator(ALLOC_OBJECT_SWAPCHAIN));
+            break;
+        default:
+            printf("vk_defer_destroy: unsupported object type %d, leaking handle\n", entry->type);
+            break;
+    }
+}
+
+void vk_defer_destroy(uint64_t handle, VkObjectType type) {
+    if (handle == 0) {
+        return;
+    }
+    push_entry(handle, type);
+}
+
+void vk_defer_destroy_buffer(VkBuffer* buffer, MemoryAllocation* allocation) {
+    if (*buffer != VK_NULL_HANDLE) {
+        DeferredDestroy* entry = push_entry((uint64_t)*buffer, VK_OBJECT_TYPE_BUFFER);
+        entry->allocation = *allocation;
+    } else {
+        memory_free(allocation); // Nothing on the GPU references a range with no buffer
+    }
+    *buffer = VK_NULL_HANDLE;
+    memset(allocation, 0, sizeof(*allocation));
+}
+
+void vk_defer_free(MemoryAllocation* allocation) {
+    if (allocation->memory != VK_NULL_HANDLE) {
+        DeferredDestroy* entry = push_entry((uint64_t)allocation->memory, VK_OBJECT_TYPE_DEVICE_MEMORY);
+        entry->allocation = *allocation;
+    }
+    memset(allocation, 0, sizeof(*allocation));
+}
+
+void vk_defer_sweep(void) {
+    // Frames complete in order, so the queue is retired front to back
+    uint64_t completed = vulkan_frame_completed();
+    uint32_t retired = 0;
+    while (retired < deferCtx.count && deferCtx.entries[retired].retireFrame <= completed) {
+        destroy_entry(&deferCtx.entries[retired++]);
+    }
+    if (retired > 0) {
+        memmove(deferCtx.entries, deferCtx.entries + retired, (deferCtx.count - retired) * sizeof(DeferredDestroy));
+        deferCtx.count -= retired;
+    }
+}
+
+void vk_defer_flush(void) {
+    for (uint32_t i = 0; i < deferCtx.count; i++) {
+        destroy_entry(&deferCtx.entries[i]);
+    }
+    heap_free(deferCtx.entries);
+    memset(&deferCtx, 0, sizeof(deferCtx));
+}
+
+uint32_t vk_defer_pending(void) {
+    return deferCtx.count;
+}
@@ -0,0 +1,168 @@
+#include "encoder_module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    SDL_AtomicInt issued[ENCODER_CALL_COUNT]; // This frame, added to by every recording thread
+    SDL_AtomicInt skipped[ENCODER_CALL_COUNT];
+    EncoderStats lastFrame;
+} EncoderContext;
+
+static EncoderContext encCtx = {0};
+
+static VkBool32 issue(CommandEncoder* encoder, EncoderCall call, VkBool32 redundant) {
+    if (redundant) {
+        encoder->skipped[call]++;
+        return VK_FALSE;
+    }
+    encoder->issued[call]++;
+    return VK_TRUE;
+}
+
+void encoder_begin(CommandEncoder* encoder, VkCommandBuffer commandBuffer) {
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->commandBuffer = commandBuffer;
+}
+
+void encoder_end(CommandEncoder* encoder) {
+    for (uint32_t i = 0; i < ENCODER_CALL_COUNT; i++) {
+        if (encoder->issued[i]) {
+            SDL_AddAtomicInt(&encCtx.issued[i], (int)encoder->issued[i]);
+        }
+        if (encoder->skipped[i]) {
+            SDL_AddAtomicInt(&encCtx.skipped[i], (int)encoder->skipped[i]);
+        }
+    }
+    memset(encoder->issued, 0, sizeof(encoder->issued));
+    memset(encoder->skipped, 0, sizeof(encoder->skipped));
+}
+
+void encoder_invalidate(CommandEncoder* encoder) {
+    encoder->pipeline = VK_NULL_HANDLE;
+    encoder->layout = VK_NULL_HANDLE;
+    memset(encoder->sets, 0, sizeof(encoder->sets));
+    memset(encoder->vertexBuffers, 0, sizeof(encoder->vertexBuffers));
+    encoder->indexBuffer = VK_NULL_HANDLE;
+    encoder->viewportValid = VK_FALSE;
+    encoder->scissorValid = VK_FALSE;
+}
+
+void encoder_bind_pipeline(CommandEncoder* encoder, VkPipeline pipeline) {
+    if (issue(encoder, ENCODER_CALL_PIPELINE, encoder->pipeline == pipeline)) {
+        vkCmdBindPipeline(encoder->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        encoder->pipeline = pipeline;
+    }
+}
+
+void encoder_bind_descriptor_sets(CommandEncoder* encoder, VkPipelineLayout layout, uint32_t firstSet, uint32_t count, const VkDescriptorSet* sets) {
+    if (firstSet + count > ENCODER_MAX_DESCRIPTOR_SETS) {
+        // Untracked range, bind and forget what we knew
+        vkCmdBindDescriptorSets(encoder->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, firstSet, count, sets, 0, NULL);
+        encoder->issued[ENCODER_CALL_DESCRIPTOR_SETS]++;
+        encoder->layout = VK_NULL_HANDLE;
+        memset(encoder->sets, 0, sizeof(encoder->sets));
+        return;
+    }
+    // Sets bound through another layout may be disturbed, so only compare within one layout
+    VkBool32 redundant = encoder->layout == layout && memcmp(&encoder->sets[firstSet], sets, count * sizeof(VkDescriptorSet)) == 0;
+    if (issue(encoder, ENCODER_CALL_DESCRIPTOR_SETS, redundant)) {
+        vkCmdBindDescriptorSets(encoder->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, firstSet, count, sets, 0, NULL);
+        if (encoder->layout != layout) {
+            memset(encoder->sets, 0, sizeof(encoder->sets));
+            encoder->layout = layout;
+        }
+        memcpy(&encoder->sets[firstSet], sets, count * sizeof(VkDescriptorSet));
+    }
+}
+
+void encoder_bind_vertex_buffer(CommandEncoder* encoder, uint32_t binding, VkBuffer buffer, VkDeviceSize offset) {
+    if (binding >= ENCODER_MAX_VERTEX_BINDINGS) {
+        printf("Vertex binding %u is not tracked by the encoder\n", binding);
+        exit(1);
+    }
+    VkBool32 redundant = encoder->vertexBuffers[binding] == buffer && encoder->vertexOffsets[binding] == offset;
+    if (issue(encoder, ENCODER_CALL_VERTEX_BUFFER, redundant)) {
+        vkCmdBindVertexBuffers(encoder->commandBuffer, binding, 1, &buffer, &offset);
+        encoder->vertexBuffers[binding] = buffer;
+        encoder->vertexOffsets[binding] = offset;
+    }
+}
+
+void encoder_bind_index_buffer(CommandEncoder* encoder, VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType) {
+    VkBool32 redundant = encoder->indexBuffer == buffer && encoder->indexOffset == offset && encoder->indexType == indexType;
+    if (issue(encoder, ENCODER_CALL_INDEX_BUFFER, redundant)) {
+        vkCmdBindIndexBuffer(encoder->commandBuffer, buffer, offset, indexType);
+        encoder->indexBuffer = buffer;
+        encoder->indexOffset = offset;
+        encoder->indexType = indexType;
+    }
+}
+
+void encoder_set_viewport(CommandEncoder* encoder, const VkViewport* viewport) {
+    VkBool32 redundant = encoder->viewportValid && memcmp(&encoder->viewport, viewport, sizeof(*viewport)) == 0;
+    if (issue(encoder, ENCODER_CALL_VIEWPORT, redundant)) {
+        vkCmdSetViewport(encoder->commandBuffer, 0, 1, viewport);
+        encoder->viewport = *viewport;
+        encoder->viewportValid = VK_TRUE;
+    }
+}
+
+void encoder_set_scissor(CommandEncoder* encoder, const VkRect2D* scissor) {
+    VkBool32 redundant = encoder->scissorValid && memcmp(&encoder->scissor, scissor, sizeof(*scissor)) == 0;
+    if (issue(encoder, ENCODER_CALL_SCISSOR, redundant)) {
+        vkCmdSetScissor(encoder->commandBuffer, 0, 1, scissor);
+        encoder->scissor = *scissor;
+        encoder->scissorValid = VK_TRUE;
+    }
+}
+
+void encoder_draw(CommandEncoder* encoder, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+    encoder->issued[ENCODER_CALL_DRAW]++;
+    vkCmdDraw(encoder->commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+}
+
+void encoder_draw_indexed(CommandEncoder* encoder, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
+    encoder->issued[ENCODER_CALL_DRAW]++;
+    vkCmdDrawIndexed(encoder->commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+
+void encoder_draw_indexed_indirect(CommandEncoder* encoder, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    encoder->issued[ENCODER_CALL_DRAW]++;
+    vkCmdDrawIndexedIndirect(encoder->commandBuffer, buffer, offset, drawCount, stride);
+}
+
+void encoder_frame_begin(void) {
+    for (uint32_t i = 0; i < ENCODER_CALL_COUNT; i++) {
+        SDL_SetAtomicInt(&encCtx.issued[i], 0);
+        SDL_SetAtomicInt(&encCtx.skipped[i], 0);
+    }
+}
+
+void encoder_frame_end(void) {
+    EncoderStats* stats = &encCtx.lastFrame;
+    memset(stats, 0, sizeof(*stats));
+    for (uint32_t i = 0; i < ENCODER_CALL_COUNT; i++) {
+        stats->issued[i] = (uint32_t)SDL_GetAtomicInt(&encCtx.issued[i]);
+        stats->skipped[i] = (uint32_t)SDL_GetAtomicInt(&encCtx.skipped[i]);
+        stats->totalIssued += stats->issued[i];
+        stats->totalSkipped += stats->skipped[i];
+    }
+}
+
+void encoder_get_stats(EncoderStats* stats) {
+    *stats = encCtx.lastFrame;
+}
+
+const char* encoder_call_name(EncoderCall call) {
+    switch (call) {
+        case ENCODER_CALL_PIPELINE: return "pipeline";
+        case ENCODER_CALL_DESCRIPTOR_SETS: return "descriptors";
+        case ENCODER_CALL_VERTEX_BUFFER: return "vertex";
+        case ENCODER_CALL_INDEX_BUFFER: return "index";
+        case ENCODER_CALL_VIEWPORT: return "viewport";
+        case ENCODER_CALL_SCISSOR: return "scissor";
+        case ENCODER_CALL_DRAW: return "draw";
+        default: return "unknown";
+    }
+}
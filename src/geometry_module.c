@@ -0,0 +1,476 @@
+#include "geometry_module.h"
+#include "upload_module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEOMETRY_DEFRAG_MAX_MOVES 64
+
+typedef struct {
+    VkBuffer buffer; // VK_NULL_HANDLE for an unused slot
+    MemoryAllocation memory;
+    RangeAllocator ranges;
+    uint32_t pendingFrees; // Entries in the pending list still pointing into this block
+} GeometryBlock;
+
+// Block 0 is created at init and kept; the others come and go with demand
+typedef struct {
+    GeometryBlock blocks[GEOMETRY_MAX_BLOCKS];
+    VkBufferUsageFlags usage;
+    VkDeviceSize stride; // Every range is a whole number of elements, so offsets stay stride aligned
+    const char* name;
+} GeometryPool;
+
+// Range released while in-flight frames may still read it
+typedef struct {
+    GeometryPool* pool;
+    uint32_t block;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint64_t retireFrame;
+} PendingFree;
+
+// A range larger than one step's budget, copied a chunk per frame. The handle keeps
+// pointing at the source until the last chunk is in.
+typedef struct {
+    MeshHandle* mesh; // NULL when no move is in progress
+    GeometryPool* pool;
+    uint32_t srcBlock;
+    VkDeviceSize srcOffset;
+    uint32_t dstBlock;
+    VkDeviceSize dstOffset;
+    VkDeviceSize size;
+    VkDeviceSize copied;
+} ChunkedMove;
+
+typedef struct {
+    GeometryPool vertexPool;
+    GeometryPool indexPool;
+
+    // Live handles, patched in place by the defragmenter
+    MeshHandle** meshes;
+    uint32_t meshCount;
+    uint32_t meshCapacity;
+
+    PendingFree* pendingFrees;
+    uint32_t pendingCount;
+    uint32_t pendingCapacity;
+    VkDeviceSize releasedBytes;
+
+    // Defrag pass state
+    VkBool32 defragActive;
+    VkBool32 meshDestroyed; // Something was freed since the last pass
+    uint32_t generation;
+    uint32_t defragFrames;
+    VkDeviceSize defragMovedBytes;
+    GeometryStats defragStart;
+    ChunkedMove chunkedMove;
+} GeometryContext;
+
+static GeometryContext geoCtx = {0};
+
+static uint32_t create_block(GeometryPool* pool, VkDeviceSize minSize) {
+    for (uint32_t i = 0; i < GEOMETRY_MAX_BLOCKS; i++) {
+        GeometryBlock* block = &pool->blocks[i];
+        if (block->buffer != VK_NULL_HANDLE) {
+            continue;
+        }
+        // Meshes larger than a block get a block of their own size
+        VkDeviceSize size = minSize > GEOMETRY_BLOCK_SIZE ? minSize : GEOMETRY_BLOCK_SIZE;
+        memory_create_buffer(size, pool->usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_TAG_GEOMETRY,
+                             &block->buffer, &block->memory);
+        range_allocator_init(&block->ranges, size);
+        return i;
+    }
+    printf("Geometry %s pool exhausted (%llu bytes requested, all %u blocks in use)\n",
+           pool->name, (unsigned long long)minSize, GEOMETRY_MAX_BLOCKS);
+    exit(1);
+}
+
+static void destroy_block(GeometryBlock* block) {
+    range_allocator_destroy(&block->ranges);
+    memory_destroy_buffer(&block->buffer, &block->memory);
+    memset(block, 0, sizeof(*block));
+}
+
+// First fit in block order, so allocations and defrag moves fill the lowest blocks first
+static VkBool32 pool_alloc(GeometryPool* pool, VkDeviceSize size, VkBool32 grow, uint32_t* blockIndex, VkDeviceSize* offset) {
+    for (uint32_t i = 0; i < GEOMETRY_MAX_BLOCKS; i++) {
+        GeometryBlock* block = &pool->blocks[i];
+        if (block->buffer != VK_NULL_HANDLE && range_allocator_alloc(&block->ranges, size, 1, offset)) {
+            *blockIndex = i;
+            return VK_TRUE;
+        }
+    }
+    if (!grow) {
+        return VK_FALSE;
+    }
+    *blockIndex = create_block(pool, size);
+    return range_allocator_alloc(&pool->blocks[*blockIndex].ranges, size, 1, offset);
+}
+
+static void init_pool(GeometryPool* pool, VkBufferUsageFlags usage, VkDeviceSize stride, const char* name) {
+    memset(pool, 0, sizeof(*pool));
+    // TRANSFER_SRC lets the defragmenter copy between blocks
+    pool->usage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    pool->stride = stride;
+    pool->name = name;
+    create_block(pool, GEOMETRY_BLOCK_SIZE);
+}
+
+void init_geometry(void) {
+    memset(&geoCtx, 0, sizeof(geoCtx));
+    init_pool(&geoCtx.vertexPool, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, GEOMETRY_VERTEX_STRIDE, "vertex");
+    init_pool(&geoCtx.indexPool, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint32_t), "index");
+}
+
+void cleanup_geometry(void) {
+    heap_free(geoCtx.meshes);
+    heap_free(geoCtx.pendingFrees);
+    for (uint32_t i = 0; i < GEOMETRY_MAX_BLOCKS; i++) {
+        if (geoCtx.vertexPool.blocks[i].buffer != VK_NULL_HANDLE) {
+            destroy_block(&geoCtx.vertexPool.blocks[i]);
+        }
+        if (geoCtx.indexPool.blocks[i].buffer != VK_NULL_HANDLE) {
+            destroy_block(&geoCtx.indexPool.blocks[i]);
+        }
+    }
+}
+
+// Direct write when the block landed in host-coherent memory (UMA), staging copy otherwise
+static void write_pool(const GeometryBlock* block, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    VkMemoryPropertyFlags flags = vkCtx->memoryProperties.memoryTypes[block->memory.memoryTypeIndex].propertyFlags;
+    if (block->memory.mapped && (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        memcpy((char*)block->memory.mapped + offset, data, size);
+        return;
+    }
+    upload_buffer(block->buffer, offset, data, size);
+}
+
+// The mesh's range in one pool, returns its size in bytes
+static VkDeviceSize mesh_range(const GeometryPool* pool, const MeshHandle* mesh, uint32_t* block, VkDeviceSize* offset) {
+    if (pool == &geoCtx.vertexPool) {
+        *block = mesh->vertexBlock;
+        *offset = (VkDeviceSize)mesh->firstVertex * pool->stride;
+        return (VkDeviceSize)mesh->vertexCount * pool->stride;
+    }
+    *block = mesh->indexBlock;
+    *offset = (VkDeviceSize)mesh->firstIndex * pool->stride;
+    return (VkDeviceSize)mesh->indexCount * pool->stride;
+}
+
+static void set_mesh_range(const GeometryPool* pool, MeshHandle* mesh, uint32_t block, VkDeviceSize offset) {
+    if (pool == &geoCtx.vertexPool) {
+        mesh->vertexBlock = (uint16_t)block;
+        mesh->firstVertex = (uint32_t)(offset / pool->stride);
+    } else {
+        mesh->indexBlock = (uint16_t)block;
+        mesh->firstIndex = (uint32_t)(offset / pool->stride);
+    }
+}
+
+// Hold the range back until every frame that may reference it has completed
+static void defer_free(GeometryPool* pool, uint32_t block, VkDeviceSize offset, VkDeviceSize size) {
+    if (geoCtx.pendingCount == geoCtx.pendingCapacity) {
+        geoCtx.pendingCapacity = geoCtx.pendingCapacity ? geoCtx.pendingCapacity * 2 : 64;
+        geoCtx.pendingFrees = heap_realloc(geoCtx.pendingFrees, geoCtx.pendingCapacity * sizeof(PendingFree));
+    }
+    PendingFree* pending = &geoCtx.pendingFrees[geoCtx.pendingCount++];
+    pending->pool = pool;
+    pending->block = block;
+    pending->offset = offset;
+    pending->size = size;
+    pending->retireFrame = vulkan_frame_submitted() + 1; // The frame being recorded may still read it
+    pool->blocks[block].pendingFrees++;
+}
+
+// A block with no live ranges and no pending frees is referenced by no frame in flight,
+// so it can be destroyed right away. Block 0 stays as the pool's floor.
+static void release_empty_blocks(GeometryPool* pool) {
+    for (uint32_t i = 1; i < GEOMETRY_MAX_BLOCKS; i++) {
+        GeometryBlock* block = &pool->blocks[i];
+        if (block->buffer != VK_NULL_HANDLE && block->ranges.used == 0 && block->pendingFrees == 0) {
+            geoCtx.releasedBytes += block->ranges.capacity;
+            destroy_block(block);
+        }
+    }
+}
+
+static void retire_pending_frees(void) {
+    uint64_t completed = vulkan_frame_completed();
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < geoCtx.pendingCount; i++) {
+        PendingFree* pending = &geoCtx.pendingFrees[i];
+        if (pending->retireFrame <= completed) {
+            GeometryBlock* block = &pending->pool->blocks[pending->block];
+            range_allocator_free(&block->ranges, pending->offset, pending->size);
+            block->pendingFrees--;
+        } else {
+            geoCtx.pendingFrees[kept++] = *pending;
+        }
+    }
+    geoCtx.pendingCount = kept;
+    release_empty_blocks(&geoCtx.vertexPool);
+    release_empty_blocks(&geoCtx.indexPool);
+}
+
+void geometry_create_mesh(const float* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, MeshHandle* mesh) {
+    memset(mesh, 0, sizeof(*mesh));
+    uint32_t block;
+    VkDeviceSize offset;
+
+    VkDeviceSize vertexSize = (VkDeviceSize)vertexCount * GEOMETRY_VERTEX_STRIDE;
+    pool_alloc(&geoCtx.vertexPool, vertexSize, VK_TRUE, &block, &offset);
+    mesh->vertexCount = vertexCount;
+    set_mesh_range(&geoCtx.vertexPool, mesh, block, offset);
+    write_pool(&geoCtx.vertexPool.blocks[block], offset, vertices, vertexSize);
+
+    if (indexCount > 0) {
+        VkDeviceSize indexSize = (VkDeviceSize)indexCount * sizeof(uint32_t);
+        pool_alloc(&geoCtx.indexPool, indexSize, VK_TRUE, &block, &offset);
+        mesh->indexCount = indexCount;
+        set_mesh_range(&geoCtx.indexPool, mesh, block, offset);
+        write_pool(&geoCtx.indexPool.blocks[block], offset, indices, indexSize);
+    }
+
+    if (geoCtx.meshCount == geoCtx.meshCapacity) {
+        geoCtx.meshCapacity = geoCtx.meshCapacity ? geoCtx.meshCapacity * 2 : 64;
+        geoCtx.meshes = heap_realloc(geoCtx.meshes, geoCtx.meshCapacity * sizeof(MeshHandle*));
+    }
+    geoCtx.meshes[geoCtx.meshCount++] = mesh;
+    geoCtx.generation++;
+}
+
+static void free_mesh_range(GeometryPool* pool, const MeshHandle* mesh) {
+    uint32_t block;
+    VkDeviceSize offset;
+    VkDeviceSize size = mesh_range(pool, mesh, &block, &offset);
+    if (size > 0) {
+        defer_free(pool, block, offset, size);
+    }
+}
+
+void geometry_destroy_mesh(MeshHandle* mesh) {
+    for (uint32_t i = 0; i < geoCtx.meshCount; i++) {
+        if (geoCtx.meshes[i] == mesh) {
+            geoCtx.meshes[i] = geoCtx.meshes[--geoCtx.meshCount];
+            break;
+        }
+    }
+
+    // Chunks already recorded may still be landing in the destination
+    ChunkedMove* move = &geoCtx.chunkedMove;
+    if (move->mesh == mesh) {
+        defer_free(move->pool, move->dstBlock, move->dstOffset, move->size);
+        memset(move, 0, sizeof(*move));
+    }
+
+    free_mesh_range(&geoCtx.vertexPool, mesh);
+    free_mesh_range(&geoCtx.indexPool, mesh);
+    memset(mesh, 0, sizeof(*mesh));
+    geoCtx.meshDestroyed = VK_TRUE;
+    geoCtx.generation++;
+}
+
+void geometry_bind_mesh(CommandEncoder* encoder, const MeshHandle* mesh) {
+    encoder_bind_vertex_buffer(encoder, 0, geoCtx.vertexPool.blocks[mesh->vertexBlock].buffer, 0);
+    if (mesh->indexCount > 0) {
+        encoder_bind_index_buffer(encoder, geoCtx.indexPool.blocks[mesh->indexBlock].buffer, 0, VK_INDEX_TYPE_UINT32);
+    }
+}
+
+void geometry_draw(CommandEncoder* encoder, const MeshHandle* mesh) {
+    geometry_draw_instanced(encoder, mesh, 1, 0);
+}
+
+void geometry_draw_instanced(CommandEncoder* encoder, const MeshHandle* mesh, uint32_t instanceCount, uint32_t firstInstance) {
+    geometry_bind_mesh(encoder, mesh);
+    if (mesh->indexCount > 0) {
+        encoder_draw_indexed(encoder, mesh->indexCount, instanceCount, mesh->firstIndex, (int32_t)mesh->firstVertex, firstInstance);
+    } else {
+        encoder_draw(encoder, mesh->vertexCount, instanceCount, mesh->firstVertex, firstInstance);
+    }
+}
+
+//================================================
+// Defragmentation
+//================================================
+
+static float fragmentation(VkDeviceSize freeBytes, VkDeviceSize largestFree) {
+    return freeBytes > 0 ? 1.0f - (float)largestFree / (float)freeBytes : 0.0f;
+}
+
+static void pool_stats(const GeometryPool* pool, VkDeviceSize* freeBytes, VkDeviceSize* largestFree,
+                       VkDeviceSize* poolBytes, uint32_t* blockCount) {
+    for (uint32_t i = 0; i < GEOMETRY_MAX_BLOCKS; i++) {
+        const GeometryBlock* block = &pool->blocks[i];
+        if (block->buffer == VK_NULL_HANDLE) {
+            continue;
+        }
+        VkDeviceSize largest = range_allocator_largest_free(&block->ranges);
+        *freeBytes += block->ranges.capacity - block->ranges.used;
+        *largestFree = largest > *largestFree ? largest : *largestFree;
+        *poolBytes += block->ranges.capacity;
+        (*blockCount)++;
+    }
+}
+
+void geometry_get_stats(GeometryStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    pool_stats(&geoCtx.vertexPool, &stats->vertexFreeBytes, &stats->vertexLargestFree, &stats->vertexPoolBytes, &stats->vertexBlocks);
+    stats->vertexFragmentation = fragmentation(stats->vertexFreeBytes, stats->vertexLargestFree);
+    pool_stats(&geoCtx.indexPool, &stats->indexFreeBytes, &stats->indexLargestFree, &stats->indexPoolBytes, &stats->indexBlocks);
+    stats->indexFragmentation = fragmentation(stats->indexFreeBytes, stats->indexLargestFree);
+    stats->releasedBytes = geoCtx.releasedBytes;
+    stats->meshCount = geoCtx.meshCount;
+    stats->defragActive = geoCtx.defragActive;
+}
+
+void geometry_defrag_begin(void) {
+    if (geoCtx.defragActive) {
+        return;
+    }
+    geometry_get_stats(&geoCtx.defragStart);
+    geoCtx.defragActive = VK_TRUE;
+    geoCtx.meshDestroyed = VK_FALSE;
+    geoCtx.defragFrames = 0;
+    geoCtx.defragMovedBytes = 0;
+    printf("Geometry defrag started: vertex %.1f%% fragmented (%llu free), index %.1f%% (%llu free)\n",
+           geoCtx.defragStart.vertexFragmentation * 100.0f, (unsigned long long)geoCtx.defragStart.vertexFreeBytes,
+           geoCtx.defragStart.indexFragmentation * 100.0f, (unsigned long long)geoCtx.defragStart.indexFreeBytes);
+}
+
+// Blocks emptied by the pass are already released when this runs, so the pool sizes are the real footprint
+static void defrag_finish(void) {
+    GeometryStats after;
+    geometry_get_stats(&after);
+    printf("Geometry defrag finished in %u frames, moved %llu bytes: vertex %.1f%% -> %.1f%%, index %.1f%% -> %.1f%%, "
+           "pools %llu -> %llu bytes\n",
+           geoCtx.defragFrames, (unsigned long long)geoCtx.defragMovedBytes,
+           geoCtx.defragStart.vertexFragmentation * 100.0f, after.vertexFragmentation * 100.0f,
+           geoCtx.defragStart.indexFragmentation * 100.0f, after.indexFragmentation * 100.0f,
+           (unsigned long long)(geoCtx.defragStart.vertexPoolBytes + geoCtx.defragStart.indexPoolBytes),
+           (unsigned long long)(after.vertexPoolBytes + after.indexPoolBytes));
+    geoCtx.defragActive = VK_FALSE;
+}
+
+static void copy_range(VkCommandBuffer commandBuffer, const GeometryPool* pool, uint32_t srcBlock, VkDeviceSize srcOffset,
+                       uint32_t dstBlock, VkDeviceSize dstOffset, VkDeviceSize size) {
+    VkBufferCopy region = {srcOffset, dstOffset, size};
+    vkCmdCopyBuffer(commandBuffer, pool->blocks[srcBlock].buffer, pool->blocks[dstBlock].buffer, 1, &region);
+}
+
+// Copy the next chunk, returns the bytes recorded. Earlier chunks went out with earlier frames,
+// whose barriers already made them visible to this one.
+static VkDeviceSize continue_chunked_move(VkCommandBuffer commandBuffer, VkDeviceSize budget) {
+    ChunkedMove* move = &geoCtx.chunkedMove;
+    VkDeviceSize chunk = move->size - move->copied;
+    if (chunk > budget) {
+        chunk = budget;
+    }
+    copy_range(commandBuffer, move->pool, move->srcBlock, move->srcOffset + move->copied,
+               move->dstBlock, move->dstOffset + move->copied, chunk);
+    move->copied += chunk;
+    if (move->copied == move->size) {
+        set_mesh_range(move->pool, move->mesh, move->dstBlock, move->dstOffset);
+        defer_free(move->pool, move->srcBlock, move->srcOffset, move->size);
+        memset(move, 0, sizeof(*move));
+    }
+    return chunk;
+}
+
+// Move one range to the lowest free spot below it (an earlier block, or earlier in its own),
+// returns VK_FALSE if it is already as low as it gets. Ranges over the remaining budget
+// become the chunked move, one at a time.
+static VkBool32 move_range(VkCommandBuffer commandBuffer, GeometryPool* pool, MeshHandle* mesh,
+                           VkDeviceSize* budget, uint32_t* moveCount) {
+    ChunkedMove* move = &geoCtx.chunkedMove;
+    uint32_t oldBlock;
+    VkDeviceSize oldOffset;
+    VkDeviceSize size = mesh_range(pool, mesh, &oldBlock, &oldOffset);
+    if (size == 0 || *budget == 0 || *moveCount == GEOMETRY_DEFRAG_MAX_MOVES ||
+        (move->mesh == mesh && move->pool == pool) || (size > *budget && move->mesh != NULL)) {
+        return VK_FALSE;
+    }
+
+    uint32_t newBlock;
+    VkDeviceSize newOffset;
+    if (!pool_alloc(pool, size, VK_FALSE, &newBlock, &newOffset)) {
+        return VK_FALSE;
+    }
+    if (newBlock > oldBlock || (newBlock == oldBlock && newOffset >= oldOffset)) {
+        range_allocator_free(&pool->blocks[newBlock].ranges, newOffset, size);
+        return VK_FALSE;
+    }
+    (*moveCount)++;
+
+    if (size > *budget) {
+        move->mesh = mesh;
+        move->pool = pool;
+        move->srcBlock = oldBlock;
+        move->srcOffset = oldOffset;
+        move->dstBlock = newBlock;
+        move->dstOffset = newOffset;
+        move->size = size;
+        move->copied = 0;
+        *budget -= continue_chunked_move(commandBuffer, *budget);
+        return VK_TRUE;
+    }
+
+    // The free range cannot overlap the live one, so the copy is well defined
+    copy_range(commandBuffer, pool, oldBlock, oldOffset, newBlock, newOffset, size);
+    set_mesh_range(pool, mesh, newBlock, newOffset);
+    defer_free(pool, oldBlock, oldOffset, size);
+    *budget -= size;
+    return VK_TRUE;
+}
+
+void geometry_defrag_step(VkCommandBuffer commandBuffer) {
+    retire_pending_frees();
+
+    if (!geoCtx.defragActive) {
+        GeometryStats stats;
+        geometry_get_stats(&stats);
+        if (!geoCtx.meshDestroyed || (stats.vertexFragmentation < GEOMETRY_DEFRAG_THRESHOLD &&
+                                      stats.indexFragmentation < GEOMETRY_DEFRAG_THRESHOLD)) {
+            return;
+        }
+        geometry_defrag_begin();
+    }
+    geoCtx.defragFrames++;
+
+    VkDeviceSize budget = GEOMETRY_DEFRAG_BYTES_PER_FRAME;
+    uint32_t moveCount = 0;
+    if (geoCtx.chunkedMove.mesh != NULL) {
+        budget -= continue_chunked_move(commandBuffer, budget);
+        moveCount++;
+    }
+    for (uint32_t i = 0; i < geoCtx.meshCount && budget > 0; i++) {
+        move_range(commandBuffer, &geoCtx.vertexPool, geoCtx.meshes[i], &budget, &moveCount);
+        move_range(commandBuffer, &geoCtx.indexPool, geoCtx.meshes[i], &budget, &moveCount);
+    }
+
+    // Nothing left to move, every vacated range is back in the free list and empty blocks are gone
+    if (moveCount == 0) {
+        if (geoCtx.pendingCount == 0) {
+            defrag_finish();
+        }
+        return;
+    }
+
+    geoCtx.generation++; // Handles were patched
+    geoCtx.defragMovedBytes += GEOMETRY_DEFRAG_BYTES_PER_FRAME - budget;
+
+    // Patched handles are drawn later in this command buffer, so wait for the copies
+    VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+uint32_t geometry_generation(void) {
+    return geoCtx.generation;
+}
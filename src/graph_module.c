@@ -0,0 +1,842 @@
+#include "graph_module.h"
+#include "defer_module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRAPH_MAX_BARRIERS 16 // Per vkCmdPipelineBarrier batch
+
+// Synchronization state of one image between accesses
+typedef struct {
+    VkImageLayout layout;
+    VkPipelineStageFlags writeStages;   // Last write or layout transition, later accesses wait on it
+    VkAccessFlags writeAccess;          // Made available by the next barrier
+    VkPipelineStageFlags readStages;    // Reads since then, the next write waits on them too
+    VkPipelineStageFlags visibleStages; // Stages that already see the last write
+} GraphState;
+
+typedef struct {
+    VkImageLayout layout;
+    VkPipelineStageFlags stage;
+    VkAccessFlags access;
+    VkImageUsageFlags imageUsage;
+} GraphUsageInfo;
+
+static const GraphUsageInfo usageInfos[GRAPH_USAGE_COUNT] = {
+    [GRAPH_USAGE_COLOR_ATTACHMENT] = {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                      VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT},
+    [GRAPH_USAGE_SAMPLED] = {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT},
+    [GRAPH_USAGE_TRANSFER_SRC] = {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                  VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT},
+    [GRAPH_USAGE_TRANSFER_DST] = {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                  VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT},
+};
+
+typedef struct {
+    GraphResource resource;
+    GraphUsage usage;
+    VkBool32 write;
+    VkBool32 clear;
+    VkClearColorValue clearColor;
+} GraphAccess;
+
+typedef struct {
+    const char* name;
+    GraphPassFunc func;
+    void* userData;
+    VkSubpassContents contents;
+    GraphAccess accesses[GRAPH_MAX_PASS_ACCESSES];
+    uint32_t accessCount;
+    VkBool32 live;
+} GraphPass;
+
+typedef struct {
+    const char* name;
+    VkBool32 imported;
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags usage; // Union over this frame's accesses, transients are created with it
+    VkImage image;
+    VkImageView view;
+    uint32_t firstPass;      // Lifetime over live passes, GRAPH_NONE when nothing live uses it
+    uint32_t lastPass;
+    uint32_t slot;           // Transients only, the memory they live in
+    VkBool32 touched;        // Accessed already this frame
+    GraphState state;
+} GraphResourceInfo;
+
+// What a transient is created from. The images are kept across frames and only rebuilt when
+// the frame declares a different list, so steady state creates nothing.
+typedef struct {
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags usage;
+    uint32_t firstPass;
+    uint32_t lastPass;
+} TransientDesc;
+
+// Memory shared by transients whose lifetimes do not overlap
+typedef struct {
+    MemoryAllocation allocation;
+    VkMemoryRequirements requirements; // Covers every image placed in it
+    VkPipelineStageFlags stages;       // Last accesses to this memory, by any of its images
+    VkAccessFlags writeAccess;
+} TransientSlot;
+
+typedef struct {
+    uint32_t count;
+    VkFormat formats[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkAttachmentLoadOp loadOps[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkAttachmentStoreOp storeOps[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkRenderPass renderPass;
+} RenderPassEntry;
+
+typedef struct {
+    VkRenderPass renderPass;
+    uint32_t count;
+    VkImageView views[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkExtent2D extent;
+    VkFramebuffer framebuffer;
+} FramebufferEntry;
+
+typedef struct {
+    VkImageMemoryBarrier barriers[GRAPH_MAX_BARRIERS];
+    uint32_t count;
+    VkPipelineStageFlags srcStages;
+    VkPipelineStageFlags dstStages;
+} BarrierBatch;
+
+typedef struct {
+    GraphPass passes[GRAPH_MAX_PASSES];
+    uint32_t passCount;
+    GraphResourceInfo resources[GRAPH_MAX_RESOURCES];
+    uint32_t resourceCount;
+
+    TransientDesc transientDescs[GRAPH_MAX_RESOURCES];
+    VkImage transientImages[GRAPH_MAX_RESOURCES];
+    VkImageView transientViews[GRAPH_MAX_RESOURCES];
+    uint32_t transientSlots[GRAPH_MAX_RESOURCES];
+    uint32_t transientCount;
+    TransientSlot slots[GRAPH_MAX_RESOURCES];
+    uint32_t slotCount;
+
+    RenderPassEntry renderPasses[GRAPH_MAX_RENDER_PASSES];
+    uint32_t renderPassCount;
+    FramebufferEntry framebuffers[GRAPH_MAX_FRAMEBUFFERS];
+    uint32_t framebufferCount;
+
+    GraphStats stats;
+} GraphContext;
+
+static GraphContext graphCtx = {0};
+
+//================================================
+// Caches
+//================================================
+
+static void flush_framebuffers(void) {
+    for (uint32_t i = 0; i < graphCtx.framebufferCount; i++) {
+        vk_defer_destroy((uint64_t)graphCtx.framebuffers[i].framebuffer, VK_OBJECT_TYPE_FRAMEBUFFER);
+    }
+    graphCtx.framebufferCount = 0;
+}
+
+// Attachments stay in COLOR_ATTACHMENT_OPTIMAL for the whole instance; the graph records the
+// transitions around it, so no subpass dependencies are needed
+static VkRenderPass get_render_pass(uint32_t count, const VkFormat* formats, const VkAttachmentLoadOp* loadOps, const VkAttachmentStoreOp* storeOps) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    for (uint32_t i = 0; i < graphCtx.renderPassCount; i++) {
+        RenderPassEntry* entry = &graphCtx.renderPasses[i];
+        if (entry->count == count &&
+            memcmp(entry->formats, formats, count * sizeof(VkFormat)) == 0 &&
+            memcmp(entry->loadOps, loadOps, count * sizeof(VkAttachmentLoadOp)) == 0 &&
+            memcmp(entry->storeOps, storeOps, count * sizeof(VkAttachmentStoreOp)) == 0) {
+            return entry->renderPass;
+        }
+    }
+    if (graphCtx.renderPassCount == GRAPH_MAX_RENDER_PASSES) {
+        printf("Frame graph needs more than %d render pass setups\n", GRAPH_MAX_RENDER_PASSES);
+        exit(1);
+    }
+
+    VkAttachmentDescription attachments[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkAttachmentReference references[GRAPH_MAX_COLOR_ATTACHMENTS];
+    memset(attachments, 0, sizeof(attachments));
+    for (uint32_t i = 0; i < count; i++) {
+        attachments[i].format = formats[i];
+        attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[i].loadOp = loadOps[i];
+        attachments[i].storeOp = storeOps[i];
+        attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[i].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        attachments[i].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        references[i].attachment = i;
+        references[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = count;
+    subpass.pColorAttachments = references;
+
+    VkRenderPassCreateInfo renderPassInfo = {VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+    renderPassInfo.attachmentCount = count;
+    renderPassInfo.pAttachments = attachments;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    RenderPassEntry* entry = &graphCtx.renderPasses[graphCtx.renderPassCount];
+    if (vkCreateRenderPass(vkCtx->device, &renderPassInfo, vk_allocator(ALLOC_OBJECT_RENDER_PASS), &entry->renderPass) != VK_SUCCESS) {
+        printf("Failed to create graph render pass\n");
+        exit(1);
+    }
+    entry->count = count;
+    memcpy(entry->formats, formats, count * sizeof(VkFormat));
+    memcpy(entry->loadOps, loadOps, count * sizeof(VkAttachmentLoadOp));
+    memcpy(entry->storeOps, storeOps, count * sizeof(VkAttachmentStoreOp));
+    graphCtx.renderPassCount++;
+    return entry->renderPass;
+}
+
+static VkFramebuffer get_framebuffer(VkRenderPass renderPass, uint32_t count, const VkImageView* views, VkExtent2D extent) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    for (uint32_t i = 0; i < graphCtx.framebufferCount; i++) {
+        FramebufferEntry* entry = &graphCtx.framebuffers[i];
+        if (entry->renderPass == renderPass && entry->count == count &&
+            entry->extent.width == extent.width && entry->extent.height == extent.height &&
+            memcmp(entry->views, views, count * sizeof(VkImageView)) == 0) {
+            return entry->framebuffer;
+        }
+    }
+    if (graphCtx.framebufferCount == GRAPH_MAX_FRAMEBUFFERS) {
+        flush_framebuffers(); // Ones used earlier this frame outlive it in the defer queue
+    }
+
+    VkFramebufferCreateInfo framebufferInfo = {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = count;
+    framebufferInfo.pAttachments = views;
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
+    framebufferInfo.layers = 1;
+
+    FramebufferEntry* entry = &graphCtx.framebuffers[graphCtx.framebufferCount];
+    if (vkCreateFramebuffer(vkCtx->device, &framebufferInfo, vk_allocator(ALLOC_OBJECT_FRAMEBUFFER), &entry->framebuffer) != VK_SUCCESS) {
+        printf("Failed to create graph framebuffer\n");
+        exit(1);
+    }
+    entry->renderPass = renderPass;
+    entry->count = count;
+    memcpy(entry->views, views, count * sizeof(VkImageView));
+    entry->extent = extent;
+    graphCtx.framebufferCount++;
+    return entry->framebuffer;
+}
+
+//================================================
+// Transient images
+//================================================
+
+static void destroy_transients(void) {
+    flush_framebuffers();
+    for (uint32_t i = 0; i < graphCtx.transientCount; i++) {
+        vk_defer_destroy((uint64_t)graphCtx.transientViews[i], VK_OBJECT_TYPE_IMAGE_VIEW);
+        vk_defer_destroy((uint64_t)graphCtx.transientImages[i], VK_OBJECT_TYPE_IMAGE);
+    }
+    // Queued after the images, so it is released once they are gone
+    for (uint32_t i = 0; i < graphCtx.slotCount; i++) {
+        vk_defer_free(&graphCtx.slots[i].allocation);
+    }
+    graphCtx.transientCount = 0;
+    graphCtx.slotCount = 0;
+    graphCtx.stats.transientImages = 0;
+    graphCtx.stats.transientBytes = 0;
+    graphCtx.stats.aliasedBytes = 0;
+}
+
+static VkBool32 lifetimes_overlap(const TransientDesc* a, const TransientDesc* b) {
+    return a->firstPass <= b->lastPass && b->firstPass <= a->lastPass;
+}
+
+static void build_transients(const TransientDesc* descs, uint32_t count) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    destroy_transients();
+
+    VkMemoryRequirements requirements[GRAPH_MAX_RESOURCES];
+    uint32_t order[GRAPH_MAX_RESOURCES];
+    for (uint32_t i = 0; i < count; i++) {
+        VkImageCreateInfo imageInfo = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = descs[i].format;
+        imageInfo.extent = (VkExtent3D){descs[i].extent.width, descs[i].extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = descs[i].usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(vkCtx->device, &imageInfo, vk_allocator(ALLOC_OBJECT_IMAGE), &graphCtx.transientImages[i]) != VK_SUCCESS) {
+            printf("Failed to create transient image\n");
+            exit(1);
+        }
+        vkGetImageMemoryRequirements(vkCtx->device, graphCtx.transientImages[i], &requirements[i]);
+        graphCtx.transientDescs[i] = descs[i];
+        graphCtx.transientSlots[i] = GRAPH_NONE;
+        order[i] = i;
+    }
+    graphCtx.transientCount = count;
+
+    // Largest first, each into the first slot whose images are all dead while it is alive
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t index = order[i];
+        uint32_t j = i;
+        for (; j > 0 && requirements[order[j - 1]].size < requirements[index].size; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = index;
+    }
+    VkDeviceSize imageBytes = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t index = order[i];
+        const VkMemoryRequirements* req = &requirements[index];
+        imageBytes += req->size;
+        uint32_t slot = 0;
+        for (; slot < graphCtx.slotCount; slot++) {
+            if (!(graphCtx.slots[slot].requirements.memoryTypeBits & req->memoryTypeBits)) {
+                continue;
+            }
+            VkBool32 free = VK_TRUE;
+            for (uint32_t other = 0; other < count && free; other++) {
+                if (graphCtx.transientSlots[other] == slot && lifetimes_overlap(&descs[other], &descs[index])) {
+                    free = VK_FALSE;
+                }
+            }
+            if (free) {
+                break;
+            }
+        }
+        TransientSlot* target = &graphCtx.slots[slot];
+        if (slot == graphCtx.slotCount) {
+            memset(target, 0, sizeof(*target));
+            target->requirements = *req;
+            graphCtx.slotCount++;
+        } else {
+            target->requirements.size = SDL_max(target->requirements.size, req->size);
+            target->requirements.alignment = SDL_max(target->requirements.alignment, req->alignment);
+            target->requirements.memoryTypeBits &= req->memoryTypeBits;
+        }
+        graphCtx.transientSlots[index] = slot;
+    }
+
+    VkDeviceSize slotBytes = 0;
+    for (uint32_t i = 0; i < graphCtx.slotCount; i++) {
+        memory_allocate(&graphCtx.slots[i].requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_TAG_ATTACHMENT, &graphCtx.slots[i].allocation);
+        slotBytes += graphCtx.slots[i].requirements.size;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const MemoryAllocation* allocation = &graphCtx.slots[graphCtx.transientSlots[i]].allocation;
+        if (vkBindImageMemory(vkCtx->device, graphCtx.transientImages[i], allocation->memory, allocation->offset) != VK_SUCCESS) {
+            printf("Failed to bind transient image memory\n");
+            exit(1);
+        }
+
+        VkImageViewCreateInfo viewInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+        viewInfo.image = graphCtx.transientImages[i];
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = descs[i].format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(vkCtx->device, &viewInfo, vk_allocator(ALLOC_OBJECT_IMAGE_VIEW), &graphCtx.transientViews[i]) != VK_SUCCESS) {
+            printf("Failed to create transient image view\n");
+            exit(1);
+        }
+    }
+
+    graphCtx.stats.transientImages = count;
+    graphCtx.stats.transientBytes = slotBytes;
+    graphCtx.stats.aliasedBytes = imageBytes - slotBytes;
+}
+
+// Binds this frame's transients to images, rebuilding them when the declarations changed
+static void place_transients(void) {
+    TransientDesc descs[GRAPH_MAX_RESOURCES];
+    uint32_t indices[GRAPH_MAX_RESOURCES];
+    uint32_t count = 0;
+    memset(descs, 0, sizeof(descs));
+    for (uint32_t r = 0; r < graphCtx.resourceCount; r++) {
+        GraphResourceInfo* resource = &graphCtx.resources[r];
+        if (resource->imported || resource->firstPass == GRAPH_NONE) {
+            continue;
+        }
+        descs[count].format = resource->format;
+        descs[count].extent = resource->extent;
+        descs[count].usage = resource->usage;
+        descs[count].firstPass = resource->firstPass;
+        descs[count].lastPass = resource->lastPass;
+        indices[count++] = r;
+    }
+
+    if (count != graphCtx.transientCount || memcmp(descs, graphCtx.transientDescs, count * sizeof(TransientDesc)) != 0) {
+        build_transients(descs, count);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        GraphResourceInfo* resource = &graphCtx.resources[indices[i]];
+        resource->image = graphCtx.transientImages[i];
+        resource->view = graphCtx.transientViews[i];
+        resource->slot = graphCtx.transientSlots[i];
+    }
+}
+
+//================================================
+// Compilation
+//================================================
+
+// Walks back from the imported images: a pass survives when it writes something a later
+// surviving pass (or the presentation engine) still needs
+static void cull_passes(void) {
+    VkBool32 needed[GRAPH_MAX_RESOURCES];
+    for (uint32_t r = 0; r < graphCtx.resourceCount; r++) {
+        needed[r] = graphCtx.resources[r].imported;
+    }
+
+    graphCtx.stats.culledPasses = 0;
+    for (uint32_t p = graphCtx.passCount; p-- > 0;) {
+        GraphPass* pass = &graphCtx.passes[p];
+        VkBool32 writes = VK_FALSE;
+        pass->live = VK_FALSE;
+        for (uint32_t a = 0; a < pass->accessCount; a++) {
+            const GraphAccess* access = &pass->accesses[a];
+            writes |= access->write;
+            if (access->write && needed[access->resource]) {
+                pass->live = VK_TRUE;
+            }
+        }
+        if (!writes) {
+            pass->live = VK_TRUE; // Side effects the graph cannot see
+        }
+        if (!pass->live) {
+            graphCtx.stats.culledPasses++;
+            continue;
+        }
+        // A clear makes earlier contents irrelevant; reads and loads keep them needed
+        for (uint32_t a = 0; a < pass->accessCount; a++) {
+            if (pass->accesses[a].clear) {
+                needed[pass->accesses[a].resource] = VK_FALSE;
+            }
+        }
+        for (uint32_t a = 0; a < pass->accessCount; a++) {
+            const GraphAccess* access = &pass->accesses[a];
+            if (!access->write || (access->usage == GRAPH_USAGE_COLOR_ATTACHMENT && !access->clear)) {
+                needed[access->resource] = VK_TRUE;
+            }
+        }
+    }
+}
+
+static void compute_lifetimes(void) {
+    for (uint32_t r = 0; r < graphCtx.resourceCount; r++) {
+        graphCtx.resources[r].firstPass = GRAPH_NONE;
+        graphCtx.resources[r].lastPass = GRAPH_NONE;
+        graphCtx.resources[r].usage = 0;
+    }
+    for (uint32_t p = 0; p < graphCtx.passCount; p++) {
+        const GraphPass* pass = &graphCtx.passes[p];
+        if (!pass->live) {
+            continue;
+        }
+        for (uint32_t a = 0; a < pass->accessCount; a++) {
+            GraphResourceInfo* resource = &graphCtx.resources[pass->accesses[a].resource];
+            if (resource->firstPass == GRAPH_NONE) {
+                resource->firstPass = p;
+            }
+            resource->lastPass = p;
+            resource->usage |= usageInfos[pass->accesses[a].usage].imageUsage;
+        }
+    }
+}
+
+// Color attachments of a pass, in declaration order
+static uint32_t pass_attachments(const GraphPass* pass, const GraphAccess** attachments) {
+    uint32_t count = 0;
+    for (uint32_t a = 0; a < pass->accessCount; a++) {
+        if (pass->accesses[a].usage == GRAPH_USAGE_COLOR_ATTACHMENT) {
+            attachments[count++] = &pass->accesses[a];
+        }
+    }
+    return count;
+}
+
+// Merged passes draw into the same subpass one after another: same attachments, loaded
+// rather than cleared, same contents, and nothing else touching those attachments
+static VkBool32 can_merge(const GraphPass* first, const GraphPass* next) {
+    const GraphAccess* firstAttachments[GRAPH_MAX_COLOR_ATTACHMENTS];
+    const GraphAccess* nextAttachments[GRAPH_MAX_COLOR_ATTACHMENTS];
+    uint32_t count = pass_attachments(first, firstAttachments);
+    if (next->contents != first->contents || pass_attachments(next, nextAttachments) != count) {
+        return VK_FALSE;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (nextAttachments[i]->resource != firstAttachments[i]->resource || nextAttachments[i]->clear) {
+            return VK_FALSE;
+        }
+    }
+    for (uint32_t a = 0; a < next->accessCount; a++) {
+        const GraphAccess* access = &next->accesses[a];
+        if (access->usage == GRAPH_USAGE_COLOR_ATTACHMENT) {
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (access->resource == firstAttachments[i]->resource) {
+                return VK_FALSE;
+            }
+        }
+    }
+    return VK_TRUE;
+}
+
+//================================================
+// Barriers
+//================================================
+
+static void flush_barriers(VkCommandBuffer commandBuffer, BarrierBatch* batch) {
+    if (batch->count == 0) {
+        return;
+    }
+    vkCmdPipelineBarrier(commandBuffer, batch->srcStages, batch->dstStages, 0, 0, NULL, 0, NULL, batch->count, batch->barriers);
+    graphCtx.stats.barriers += batch->count;
+    batch->count = 0;
+    batch->srcStages = 0;
+    batch->dstStages = 0;
+}
+
+static void add_barrier(VkCommandBuffer commandBuffer, BarrierBatch* batch, const GraphResourceInfo* resource, VkImageLayout oldLayout,
+                        VkImageLayout newLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    if (batch->count == GRAPH_MAX_BARRIERS) {
+        flush_barriers(commandBuffer, batch);
+    }
+    const GraphState* state = &resource->state;
+    VkPipelineStageFlags srcStages = state->writeStages | state->readStages;
+    VkImageMemoryBarrier* barrier = &batch->barriers[batch->count++];
+    memset(barrier, 0, sizeof(*barrier));
+    barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier->srcAccessMask = state->writeAccess;
+    barrier->dstAccessMask = dstAccess;
+    barrier->oldLayout = oldLayout;
+    barrier->newLayout = newLayout;
+    barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->image = resource->image;
+    barrier->subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier->subresourceRange.levelCount = 1;
+    barrier->subresourceRange.layerCount = 1;
+    batch->srcStages |= srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    batch->dstStages |= dstStage;
+}
+
+// Queues the barrier `access` needs, if any. Reads in the layout the image is already in, from
+// stages that already see its last write, need none.
+static void transition(VkCommandBuffer commandBuffer, BarrierBatch* batch, const GraphAccess* access) {
+    GraphResourceInfo* resource = &graphCtx.resources[access->resource];
+    const GraphUsageInfo* info = &usageInfos[access->usage];
+    GraphState* state = &resource->state;
+    if (!resource->touched && !resource->imported) {
+        // Contents start undefined; wait for whichever image used this memory last
+        const TransientSlot* slot = &graphCtx.slots[resource->slot];
+        memset(state, 0, sizeof(*state));
+        state->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        state->writeStages = slot->stages;
+        state->writeAccess = slot->writeAccess;
+    }
+    resource->touched = VK_TRUE;
+
+    VkBool32 layoutChange = state->layout != info->layout;
+    if (!access->write && !layoutChange && (info->stage & ~state->visibleStages) == 0) {
+        state->readStages |= info->stage;
+    } else {
+        // A clear discards the old contents, so the transition need not preserve them
+        add_barrier(commandBuffer, batch, resource, access->clear ? VK_IMAGE_LAYOUT_UNDEFINED : state->layout,
+                    info->layout, info->stage, info->access);
+        if (access->write || layoutChange) {
+            // Layout transitions count as writes: later accesses order after this stage
+            state->writeStages = info->stage;
+            state->writeAccess = access->write ? info->access : 0;
+            state->readStages = 0;
+            state->visibleStages = access->write ? 0 : info->stage;
+        } else {
+            state->readStages |= info->stage;
+            state->visibleStages |= info->stage;
+        }
+        state->layout = info->layout;
+    }
+
+    if (!resource->imported) {
+        TransientSlot* slot = &graphCtx.slots[resource->slot];
+        slot->stages = state->writeStages | state->readStages;
+        slot->writeAccess = state->writeAccess;
+    }
+}
+
+//================================================
+// Recording
+//================================================
+
+static void record_render_group(CommandEncoder* encoder, uint32_t first, uint32_t last) {
+    VkCommandBuffer commandBuffer = encoder->commandBuffer;
+    const GraphPass* pass = &graphCtx.passes[first];
+    const GraphAccess* attachments[GRAPH_MAX_COLOR_ATTACHMENTS];
+    uint32_t count = pass_attachments(pass, attachments);
+
+    VkFormat formats[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkAttachmentLoadOp loadOps[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkAttachmentStoreOp storeOps[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkImageView views[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkClearValue clearValues[GRAPH_MAX_COLOR_ATTACHMENTS];
+    VkExtent2D extent = graphCtx.resources[attachments[0]->resource].extent;
+    for (uint32_t i = 0; i < count; i++) {
+        const GraphResourceInfo* resource = &graphCtx.resources[attachments[i]->resource];
+        if (resource->extent.width != extent.width || resource->extent.height != extent.height) {
+            printf("Frame graph pass '%s': attachments differ in size\n", pass->name);
+            exit(1);
+        }
+        formats[i] = resource->format;
+        views[i] = resource->view;
+        clearValues[i].color = attachments[i]->clearColor;
+        // Only keep what a later pass or the presentation engine reads, and only load what exists
+        if (attachments[i]->clear) {
+            loadOps[i] = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        } else {
+            loadOps[i] = resource->touched ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        }
+        storeOps[i] = resource->imported || resource->lastPass > last ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    }
+
+    // One batch for the whole instance, barriers are not allowed inside it
+    BarrierBatch batch = {0};
+    for (uint32_t i = 0; i < count; i++) {
+        transition(commandBuffer, &batch, attachments[i]);
+    }
+    for (uint32_t p = first; p <= last; p++) {
+        const GraphPass* member = &graphCtx.passes[p];
+        if (!member->live) {
+            continue;
+        }
+        for (uint32_t a = 0; a < member->accessCount; a++) {
+            if (member->accesses[a].usage != GRAPH_USAGE_COLOR_ATTACHMENT) {
+                transition(commandBuffer, &batch, &member->accesses[a]);
+            }
+        }
+    }
+    flush_barriers(commandBuffer, &batch);
+
+    GraphPassContext context;
+    context.renderPass = get_render_pass(count, formats, loadOps, storeOps);
+    context.framebuffer = get_framebuffer(context.renderPass, count, views, extent);
+    context.extent = extent;
+    context.contents = pass->contents;
+
+    // Ahead of the render pass: a subpass with secondary contents only accepts vkCmdExecuteCommands
+    VkViewport viewport = {0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f};
+    encoder_set_viewport(encoder, &viewport);
+    VkRect2D scissor = {{0, 0}, extent};
+    encoder_set_scissor(encoder, &scissor);
+
+    VkRenderPassBeginInfo renderPassInfo = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+    renderPassInfo.renderPass = context.renderPass;
+    renderPassInfo.framebuffer = context.framebuffer;
+    renderPassInfo.renderArea.offset = (VkOffset2D){0, 0};
+    renderPassInfo.renderArea.extent = extent;
+    renderPassInfo.clearValueCount = count;
+    renderPassInfo.pClearValues = clearValues;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass->contents);
+    for (uint32_t p = first; p <= last; p++) {
+        const GraphPass* member = &graphCtx.passes[p];
+        if (member->live && member->func) {
+            member->func(encoder, &context, member->userData);
+        }
+    }
+    vkCmdEndRenderPass(commandBuffer);
+    graphCtx.stats.renderPasses++;
+}
+
+static void record_pass(CommandEncoder* encoder, const GraphPass* pass) {
+    BarrierBatch batch = {0};
+    for (uint32_t a = 0; a < pass->accessCount; a++) {
+        transition(encoder->commandBuffer, &batch, &pass->accesses[a]);
+    }
+    flush_barriers(encoder->commandBuffer, &batch);
+
+    GraphPassContext context = {0};
+    context.contents = pass->contents;
+    if (pass->accessCount > 0) {
+        context.extent = graphCtx.resources[pass->accesses[0].resource].extent;
+    }
+    if (pass->func) {
+        pass->func(encoder, &context, pass->userData);
+    }
+}
+
+//================================================
+// API
+//================================================
+
+void init_graph(void) {
+    memset(&graphCtx, 0, sizeof(graphCtx));
+}
+
+void cleanup_graph(void) {
+    destroy_transients();
+    for (uint32_t i = 0; i < graphCtx.renderPassCount; i++) {
+        vk_defer_destroy((uint64_t)graphCtx.renderPasses[i].renderPass, VK_OBJECT_TYPE_RENDER_PASS);
+    }
+    memset(&graphCtx, 0, sizeof(graphCtx));
+}
+
+void graph_invalidate(void) {
+    flush_framebuffers();
+}
+
+void graph_begin(void) {
+    graphCtx.passCount = 0;
+    graphCtx.resourceCount = 0;
+}
+
+static GraphResourceInfo* add_resource(const char* name, VkFormat format, VkExtent2D extent) {
+    if (graphCtx.resourceCount == GRAPH_MAX_RESOURCES) {
+        printf("Frame graph resource '%s' exceeds GRAPH_MAX_RESOURCES\n", name);
+        exit(1);
+    }
+    GraphResourceInfo* resource = &graphCtx.resources[graphCtx.resourceCount++];
+    memset(resource, 0, sizeof(*resource));
+    resource->name = name;
+    resource->format = format;
+    resource->extent = extent;
+    resource->slot = GRAPH_NONE;
+    return resource;
+}
+
+GraphResource graph_import_swapchain(uint32_t imageIndex) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    GraphResourceInfo* resource = add_resource("swapchain", vkCtx->surfaceFormat.format, (VkExtent2D){vkCtx->width, vkCtx->height});
+    resource->imported = VK_TRUE;
+    resource->image = vkCtx->swapchainImages[imageIndex];
+    resource->view = vkCtx->swapchainImageViews[imageIndex];
+    // The submit waits for the acquire at COLOR_ATTACHMENT_OUTPUT; the first barrier chains to it
+    resource->state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource->state.writeStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    return graphCtx.resourceCount - 1;
+}
+
+GraphResource graph_create_image(const char* name, VkFormat format, VkExtent2D extent) {
+    add_resource(name, format, extent);
+    return graphCtx.resourceCount - 1;
+}
+
+uint32_t graph_add_pass(const char* name, GraphPassFunc func, void* userData, VkSubpassContents contents) {
+    if (graphCtx.passCount == GRAPH_MAX_PASSES) {
+        printf("Frame graph pass '%s' exceeds GRAPH_MAX_PASSES\n", name);
+        exit(1);
+    }
+    GraphPass* pass = &graphCtx.passes[graphCtx.passCount];
+    memset(pass, 0, sizeof(*pass));
+    pass->name = name;
+    pass->func = func;
+    pass->userData = userData;
+    pass->contents = contents;
+    return graphCtx.passCount++;
+}
+
+static GraphAccess* add_access(uint32_t pass, GraphResource resource, GraphUsage usage, VkBool32 write) {
+    GraphPass* target = &graphCtx.passes[pass];
+    if (target->accessCount == GRAPH_MAX_PASS_ACCESSES) {
+        printf("Frame graph pass '%s' exceeds GRAPH_MAX_PASS_ACCESSES\n", target->name);
+        exit(1);
+    }
+    GraphAccess* access = &target->accesses[target->accessCount++];
+    memset(access, 0, sizeof(*access));
+    access->resource = resource;
+    access->usage = usage;
+    access->write = write || usage == GRAPH_USAGE_COLOR_ATTACHMENT;
+    return access;
+}
+
+void graph_read(uint32_t pass, GraphResource resource, GraphUsage usage) {
+    add_access(pass, resource, usage, VK_FALSE);
+}
+
+void graph_write(uint32_t pass, GraphResource resource, GraphUsage usage) {
+    add_access(pass, resource, usage, VK_TRUE);
+}
+
+void graph_write_clear(uint32_t pass, GraphResource resource, VkClearColorValue color) {
+    GraphAccess* access = add_access(pass, resource, GRAPH_USAGE_COLOR_ATTACHMENT, VK_TRUE);
+    access->clear = VK_TRUE;
+    access->clearColor = color;
+}
+
+void graph_execute(CommandEncoder* encoder) {
+    graphCtx.stats.passes = graphCtx.passCount;
+    graphCtx.stats.renderPasses = 0;
+    graphCtx.stats.barriers = 0;
+    cull_passes();
+    compute_lifetimes();
+    place_transients();
+    for (uint32_t r = 0; r < graphCtx.resourceCount; r++) {
+        graphCtx.resources[r].touched = VK_FALSE;
+    }
+
+    uint32_t p = 0;
+    while (p < graphCtx.passCount) {
+        const GraphPass* pass = &graphCtx.passes[p];
+        const GraphAccess* attachments[GRAPH_MAX_COLOR_ATTACHMENTS];
+        if (!pass->live) {
+            p++;
+            continue;
+        }
+        if (pass_attachments(pass, attachments) == 0) {
+            record_pass(encoder, pass);
+            p++;
+            continue;
+        }
+        // Extend the instance over following live passes that can share it; culled ones in
+        // between are skipped
+        uint32_t last = p;
+        for (uint32_t next = p + 1; next < graphCtx.passCount; next++) {
+            if (!graphCtx.passes[next].live) {
+                continue;
+            }
+            if (!can_merge(pass, &graphCtx.passes[next])) {
+                break;
+            }
+            last = next;
+        }
+        record_render_group(encoder, p, last);
+        p = last + 1;
+    }
+
+    // Hand imported images to the presentation engine
+    BarrierBatch batch = {0};
+    for (uint32_t r = 0; r < graphCtx.resourceCount; r++) {
+        GraphResourceInfo* resource = &graphCtx.resources[r];
+        if (resource->imported) {
+            add_barrier(encoder->commandBuffer, &batch, resource, resource->state.layout, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+        }
+    }
+    flush_barriers(encoder->commandBuffer, &batch);
+}
+
+VkImage graph_image(GraphResource resource) {
+    return graphCtx.resources[resource].image;
+}
+
+VkExtent2D graph_extent(GraphResource resource) {
+    return graphCtx.resources[resource].extent;
+}
+
+void graph_get_stats(GraphStats* stats) {
+    *stats = graphCtx.stats;
+}
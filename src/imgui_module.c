@@ -2,10 +2,29 @@
 #include "cimgui.h"
 #include "cimgui_impl.h"
 #include "triangle_module.h"
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <vulkan/vulkan.h>
 
 #define igGetIO igGetIO_Nil
+#define IMGUI_MAX_DYING_TEXTURES 32
+
+// ImGui's textures belong to the main thread, which keeps changing them while it builds the next
+// frame. Each one gets a twin, kept in its BackendUserData, that only the render thread and the
+// backend touch; changes reach the twin as requests carried by the snapshot.
+typedef struct {
+    // Main thread
+    ImGuiTextureRequest pending[IMGUI_MAX_TEXTURE_REQUESTS];
+    uint32_t pendingCount;
+    uint32_t nextSerial;
+    // Render thread
+    uint32_t appliedSerial;
+    ImTextureData* dying[IMGUI_MAX_DYING_TEXTURES]; // Destroyed once no frame in flight can sample them
+    uint32_t dyingCount;
+} ImGuiTextureContext;
+
+static ImGuiTextureContext textureCtx = {0};
 
 void init_imgui(SDL_Window* window) {
     VulkanContext* vkCtx = get_vulkan_context();
@@ -34,7 +53,7 @@ void init_imgui(SDL_Window* window) {
     pool_info.poolSizeCount = sizeof(pool_sizes) / sizeof(pool_sizes[0]);
     pool_info.pPoolSizes = pool_sizes;
 
-    if (vkCreateDescriptorPool(vkCtx->device, &pool_info, NULL, &vkCtx->imguiDescriptorPool) != VK_SUCCESS) {
+    if (vkCreateDescriptorPool(vkCtx->device, &pool_info, vk_allocator(ALLOC_OBJECT_DESCRIPTOR), &vkCtx->imguiDescriptorPool) != VK_SUCCESS) {
         printf("Failed to create ImGui descriptor pool\n");
         exit(1);
     }
@@ -47,9 +66,11 @@ void init_imgui(SDL_Window* window) {
     init_info.Queue = vkCtx->graphicsQueue;
     init_info.DescriptorPool = vkCtx->imguiDescriptorPool;
     init_info.MinImageCount = 2;
-    init_info.ImageCount = vkCtx->imageCount;
+    // The backend rotates its vertex buffers over ImageCount, which must cover every frame in flight
+    init_info.ImageCount = vkCtx->imageCount > MAX_FRAMES_IN_FLIGHT ? vkCtx->imageCount : MAX_FRAMES_IN_FLIGHT;
     init_info.RenderPass = vkCtx->renderPass;
     init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
+    init_info.Allocator = vk_allocator(ALLOC_OBJECT_IMGUI);
 
     if (!ImGui_ImplVulkan_Init(&init_info)) {
         printf("Failed to initialize ImGui Vulkan backend\n");
@@ -94,30 +115,264 @@ void cleanup_imgui(void) {
     ImGui_ImplVulkan_Shutdown();
     ImGui_ImplSDL3_Shutdown();
     igDestroyContext(NULL);
-    vkDestroyDescriptorPool(vkCtx->device, vkCtx->imguiDescriptorPool, NULL);
+    vkDestroyDescriptorPool(vkCtx->device, vkCtx->imguiDescriptorPool, vk_allocator(ALLOC_OBJECT_DESCRIPTOR));
 }
 
-void render_imgui(uint32_t imageIndex) {
-    VulkanContext* vkCtx = get_vulkan_context();
+void render_imgui(CommandEncoder* encoder, ImDrawData* drawData) {
+    ImGui_ImplVulkan_RenderDrawData(drawData, encoder->commandBuffer, VK_NULL_HANDLE);
+    encoder_invalidate(encoder); // The backend binds its own pipeline, buffers and viewport
+}
+
+//================================================
+// Textures
+//================================================
+
+static void queue_texture_request(ImTextureData* source, ImTextureStatus status, ImTextureData* twin) {
+    ImGuiTextureRequest* request = &textureCtx.pending[textureCtx.pendingCount++];
+    memset(request, 0, sizeof(*request));
+    request->serial = ++textureCtx.nextSerial;
+    request->status = status;
+    request->texture = twin;
+    if (status == ImTextureStatus_WantDestroy) {
+        return;
+    }
+    request->format = source->Format;
+    request->width = source->Width;
+    request->height = source->Height;
+    request->bytesPerPixel = source->BytesPerPixel;
+    if (status == ImTextureStatus_WantCreate) {
+        request->rect = (ImTextureRect){0, 0, (unsigned short)source->Width, (unsigned short)source->Height};
+    } else {
+        request->rect = source->UpdateRect;
+    }
+    size_t size = (size_t)ImTextureData_GetSizeInBytes(source);
+    request->pixels = heap_alloc(size);
+    memcpy(request->pixels, source->Pixels, size);
+}
 
-    // Render triangle and quad
-    // render_triangle(vkCtx->commandBuffer);
-    // render_quad(vkCtx->commandBuffer);
+void imgui_queue_textures(uint32_t appliedSerial) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < textureCtx.pendingCount; i++) {
+        ImGuiTextureRequest* request = &textureCtx.pending[i];
+        if (request->serial <= appliedSerial) {
+            heap_free(request->pixels);
+        } else {
+            textureCtx.pending[kept++] = *request;
+        }
+    }
+    textureCtx.pendingCount = kept;
+
+    ImDrawData* drawData = igGetDrawData();
+    if (!drawData->Textures) {
+        return;
+    }
+    for (int i = 0; i < drawData->Textures->Size; i++) {
+        // A recreate needs two slots; anything that does not fit is picked up again next frame
+        if (textureCtx.pendingCount + 2 > IMGUI_MAX_TEXTURE_REQUESTS) {
+            break;
+        }
+        ImTextureData* texture = drawData->Textures->Data[i];
+        ImTextureData* twin = texture->BackendUserData;
+        switch (texture->Status) {
+            case ImTextureStatus_WantCreate:
+                if (twin) {
+                    queue_texture_request(texture, ImTextureStatus_WantDestroy, twin);
+                }
+                twin = heap_alloc(sizeof(ImTextureData));
+                memset(twin, 0, sizeof(*twin));
+                queue_texture_request(texture, ImTextureStatus_WantCreate, twin);
+                texture->BackendUserData = twin;
+                ImTextureData_SetStatus(texture, ImTextureStatus_OK);
+                break;
+            case ImTextureStatus_WantUpdates:
+                queue_texture_request(texture, ImTextureStatus_WantUpdates, twin);
+                ImTextureData_SetStatus(texture, ImTextureStatus_OK);
+                break;
+            case ImTextureStatus_WantDestroy:
+                if (twin) {
+                    queue_texture_request(texture, ImTextureStatus_WantDestroy, twin);
+                }
+                texture->BackendUserData = NULL;
+                ImTextureData_SetTexID(texture, 0); // ImTextureID_Invalid
+                ImTextureData_SetStatus(texture, ImTextureStatus_Destroyed);
+                break;
+            default:
+                break;
+        }
+    }
+}
 
-    ImGui_ImplVulkan_RenderDrawData(igGetDrawData(), vkCtx->commandBuffers[imageIndex], VK_NULL_HANDLE);
+// The backend destroys a texture once it has been unused for ImageCount frames
+static VkBool32 release_twin(ImTextureData* texture) {
+    texture->Status = ImTextureStatus_WantDestroy;
+    texture->WantDestroyNextFrame = true; // Otherwise Destroyed is turned back into WantCreate
+    ImGui_ImplVulkan_UpdateTexture(texture);
+    if (texture->Status != ImTextureStatus_Destroyed) {
+        return VK_FALSE;
+    }
+    heap_free(texture);
+    return VK_TRUE;
+}
 
+static void retire_twin(ImTextureData* texture) {
+    if (textureCtx.dyingCount == IMGUI_MAX_DYING_TEXTURES) {
+        printf("Too many ImGui textures waiting for destruction\n");
+        exit(1);
+    }
+    texture->UnusedFrames = 0;
+    textureCtx.dying[textureCtx.dyingCount++] = texture;
+}
 
+void imgui_apply_textures(const ImGuiSnapshot* snapshot) {
+    for (uint32_t i = 0; i < snapshot->textureCount; i++) {
+        const ImGuiTextureRequest* request = &snapshot->textures[i];
+        if (request->serial <= textureCtx.appliedSerial) {
+            continue;
+        }
+        ImTextureData* texture = request->texture;
+        if (request->status == ImTextureStatus_WantDestroy) {
+            retire_twin(texture); // Frames already submitted may still sample it
+        } else {
+            texture->Status = request->status;
+            texture->Format = request->format;
+            texture->Width = request->width;
+            texture->Height = request->height;
+            texture->BytesPerPixel = request->bytesPerPixel;
+            texture->Pixels = request->pixels;
+            texture->UsedRect = (ImTextureRect){0, 0, (unsigned short)request->width, (unsigned short)request->height};
+            texture->UpdateRect = request->rect;
+            // The backend uploads with its own submit, so it takes the queue lock like everyone else
+            vulkan_lock_queue();
+            ImGui_ImplVulkan_UpdateTexture(texture);
+            vulkan_unlock_queue();
+            texture->Pixels = NULL; // Owned by the request
+        }
+        textureCtx.appliedSerial = request->serial;
+    }
 
-    // Render ImGui
-    // ImGui_ImplVulkan_RenderDrawData(igGetDrawData(), vkCtx->commandBuffer, VK_NULL_HANDLE);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < textureCtx.dyingCount; i++) {
+        ImTextureData* texture = textureCtx.dying[i];
+        texture->UnusedFrames++;
+        if (!release_twin(texture)) {
+            textureCtx.dying[kept++] = texture;
+        }
+    }
+    textureCtx.dyingCount = kept;
+}
 
-    // vkCmdEndRenderPass(vkCtx->commandBuffer);
-    // vkEndCommandBuffer(vkCtx->commandBuffer);
+uint32_t imgui_textures_applied(void) {
+    return textureCtx.appliedSerial;
+}
 
+void imgui_destroy_textures(void) {
+    // Destroys the render thread never got to, then every twin still in use
+    for (uint32_t i = 0; i < textureCtx.pendingCount; i++) {
+        ImGuiTextureRequest* request = &textureCtx.pending[i];
+        if (request->serial > textureCtx.appliedSerial && request->status == ImTextureStatus_WantDestroy) {
+            retire_twin(request->texture);
+        }
+        heap_free(request->pixels);
+    }
+    textureCtx.pendingCount = 0;
+
+    ImGuiPlatformIO* platformIO = igGetPlatformIO_Nil();
+    for (int i = 0; i < platformIO->Textures.Size; i++) {
+        ImTextureData* texture = platformIO->Textures.Data[i];
+        if (texture->BackendUserData) {
+            retire_twin(texture->BackendUserData);
+            texture->BackendUserData = NULL;
+            ImTextureData_SetTexID(texture, 0);
+            ImTextureData_SetStatus(texture, ImTextureStatus_Destroyed);
+        }
+    }
+
+    for (uint32_t i = 0; i < textureCtx.dyingCount; i++) {
+        ImTextureData* texture = textureCtx.dying[i];
+        texture->UnusedFrames = INT_MAX; // The device is idle
+        if (!release_twin(texture)) {
+            heap_free(texture); // Never reached the backend
+        }
+    }
+    textureCtx.dyingCount = 0;
+}
+
+//================================================
+// Snapshot
+//================================================
+
+static void* grow_buffer(void* buffer, int* capacity, int count, size_t elementSize) {
+    if (count <= *capacity) {
+        return buffer;
+    }
+    int newCapacity = *capacity > 0 ? *capacity : 256;
+    while (newCapacity < count) {
+        newCapacity *= 2;
+    }
+    *capacity = newCapacity;
+    return heap_realloc(buffer, (size_t)newCapacity * elementSize);
+}
+
+static void copy_draw_list(ImGuiSnapshotList* dst, const ImDrawList* src) {
+    dst->commands = grow_buffer(dst->commands, &dst->commandCapacity, src->CmdBuffer.Size, sizeof(ImDrawCmd));
+    dst->vertices = grow_buffer(dst->vertices, &dst->vertexCapacity, src->VtxBuffer.Size, sizeof(ImDrawVert));
+    dst->indices = grow_buffer(dst->indices, &dst->indexCapacity, src->IdxBuffer.Size, sizeof(ImDrawIdx));
+    memcpy(dst->commands, src->CmdBuffer.Data, (size_t)src->CmdBuffer.Size * sizeof(ImDrawCmd));
+    memcpy(dst->vertices, src->VtxBuffer.Data, (size_t)src->VtxBuffer.Size * sizeof(ImDrawVert));
+    memcpy(dst->indices, src->IdxBuffer.Data, (size_t)src->IdxBuffer.Size * sizeof(ImDrawIdx));
+
+    // Commands name ImGui's textures; the render thread draws with their twins
+    for (int i = 0; i < src->CmdBuffer.Size; i++) {
+        ImTextureRef* texRef = &dst->commands[i].TexRef;
+        if (texRef->_TexData) {
+            texRef->_TexData = texRef->_TexData->BackendUserData;
+        }
+    }
+
+    // The backend only reads the three buffers; the rest is shared read-only state
+    dst->list = *src;
+    dst->list.CmdBuffer.Data = dst->commands;
+    dst->list.CmdBuffer.Capacity = dst->commandCapacity;
+    dst->list.VtxBuffer.Data = dst->vertices;
+    dst->list.VtxBuffer.Capacity = dst->vertexCapacity;
+    dst->list.IdxBuffer.Data = dst->indices;
+    dst->list.IdxBuffer.Capacity = dst->indexCapacity;
+}
+
+void imgui_snapshot_capture(ImGuiSnapshot* snapshot) {
+    ImDrawData* src = igGetDrawData();
+    int count = src->CmdListsCount;
+    if (count > IMGUI_SNAPSHOT_MAX_LISTS) {
+        printf("ImGui produced %d draw lists, only %d are rendered\n", count, IMGUI_SNAPSHOT_MAX_LISTS);
+        count = IMGUI_SNAPSHOT_MAX_LISTS;
+    }
+    for (int i = 0; i < count; i++) {
+        copy_draw_list(&snapshot->lists[i], src->CmdLists.Data[i]);
+        snapshot->listPointers[i] = &snapshot->lists[i].list;
+    }
+
+    snapshot->drawData = *src;
+    snapshot->drawData.CmdListsCount = count;
+    snapshot->drawData.CmdLists.Data = snapshot->listPointers;
+    snapshot->drawData.CmdLists.Size = count;
+    snapshot->drawData.CmdLists.Capacity = IMGUI_SNAPSHOT_MAX_LISTS;
+    snapshot->drawData.Textures = NULL; // Replaced by the requests below
+
+    memcpy(snapshot->textures, textureCtx.pending, textureCtx.pendingCount * sizeof(ImGuiTextureRequest));
+    snapshot->textureCount = textureCtx.pendingCount;
+}
+
+void imgui_snapshot_release(ImGuiSnapshot* snapshot) {
+    for (int i = 0; i < IMGUI_SNAPSHOT_MAX_LISTS; i++) {
+        heap_free(snapshot->lists[i].commands);
+        heap_free(snapshot->lists[i].vertices);
+        heap_free(snapshot->lists[i].indices);
+    }
+    memset(snapshot, 0, sizeof(*snapshot));
 }
 
 // this ref which break up the code for render.
-// void render_imgui(uint32_t imageIndex) {
+// void render_imgui(VkCommandBuffer commandBuffer) {
 //     VulkanContext* vkCtx = get_vulkan_context();
 //     VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
 //     vkBeginCommandBuffer(vkCtx->commandBuffer, &beginInfo);
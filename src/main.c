@@ -4,19 +4,28 @@
 #include <vulkan/vulkan.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "vulkan_module.h"
 #include "imgui_module.h"
 #include "triangle_module.h"
+#include "upload_module.h"
+#include "geometry_module.h"
+#include "defer_module.h"
+#include "pacer_module.h"
+#include "render_module.h"
 #include "cimgui.h"
 #include "cimgui_impl.h"
 
 #define igGetIO igGetIO_Nil
 #define WIDTH 800
 #define HEIGHT 600
+#define ON_DEMAND_SETTLE_FRAMES 3 // Frames drawn after an event so hover and open/close states catch up
+#define ON_DEMAND_BLINK_MS 500    // Redraw period while a text field shows a blinking cursor
 
 
 int main(int argc, char* argv[]) {
+    init_arenas(); // Hooks SDL/ImGui allocations, must run first
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) < 0) {
         printf("SDL initialization failed: %s\n", SDL_GetError());
         return 1;
@@ -31,88 +40,281 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    bool onDemand = false; // Redraw only for events, animations and busy modules
+    bool benchmarkMemory = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--on-demand") == 0) {
+            onDemand = true;
+        } else if (strcmp(argv[i], "--benchmark-memory") == 0) {
+            benchmarkMemory = true;
+        }
+    }
+
     init_vulkan(window, WIDTH, HEIGHT);
+    if (benchmarkMemory) {
+        MemoryBenchmark benchmark;
+        memory_benchmark(&benchmark);
+    }
     create_triangle();
     create_quad();
+    upload_flush(); // One submit for all static geometry
     init_imgui(window);
+    init_pacer(window);
 
+    // UI state, handed to the render thread in every snapshot
+    VulkanContext* vkCtx = get_vulkan_context();
     bool showTriangle = true;
     bool showQuad = true;
+    bool lowLatency = false;
+    VkPresentModeKHR presentMode = vkCtx->presentMode;
+    int bufferedImages = (int)vkCtx->bufferedImages;
+    uint32_t resizeSerial = 0; // Resizes are coalesced by the render thread into one recreation
+    uint32_t defragSerial = 0;
+    RecordStats recordStats;
+    record_get_stats(&recordStats);
+    bool parallelRecording = false;
+    bool cacheStatic = false;
+    float renderScale = 1.0f;
+    int recordWorkers = (int)recordStats.workerCount;
+    int gridDraws = 0;
+    int quadInstances = 0;
+    int meshChurn = 0;
+    bool gpuCulling = false;
+    float cullRegion = 1.0f;
+    uint32_t benchmarkSerial = 0;
+
     bool running = true;
-    uint32_t currentFrame = 0;
+    bool hidden = false;
+    bool frameRequested = false;
+    uint32_t redrawFrames = ON_DEMAND_SETTLE_FRAMES;
+    RenderStats stats = {0};
+    render_thread_start(window); // From here on Vulkan belongs to the render thread
+    Uint32 renderReadyEvent = render_ready_event();
 
     while (running) {
+        // Sleep until input arrives or the render thread asks for the next frame. A stalled
+        // acquire or present only delays that request; events keep being handled meanwhile.
+        // On demand, an idle UI sleeps here indefinitely, apart from the text cursor blink.
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            ImGui_ImplSDL3_ProcessEvent(&event);
-            if (event.type == SDL_EVENT_QUIT) {
-                running = false;
+        bool idle = onDemand && redrawFrames == 0 && !stats.animating && meshChurn == 0;
+        Sint32 timeoutMs = idle && igGetIO()->WantTextInput ? ON_DEMAND_BLINK_MS : -1;
+        bool pending = SDL_WaitEventTimeout(&event, timeoutMs);
+        if (!pending) {
+            redrawFrames = 1; // Cursor blink
+        }
+        while (pending) {
+            if (event.type == renderReadyEvent) {
+                frameRequested = true;
+            } else {
+                redrawFrames = ON_DEMAND_SETTLE_FRAMES;
+                ImGui_ImplSDL3_ProcessEvent(&event);
+                if (event.type == SDL_EVENT_QUIT) {
+                    running = false;
+                }
+                if (event.type == SDL_EVENT_WINDOW_RESIZED || event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+                    resizeSerial++;
+                }
             }
-            if (event.type == SDL_EVENT_WINDOW_RESIZED || event.type == SDL_EVENT_WINDOW_MINIMIZED) {
-                recreate_swapchain(window);
+            pending = SDL_PollEvent(&event);
+        }
+        if (!running) {
+            break;
+        }
+
+        // Minimized, hidden or zero-sized: tell the render thread once, then ignore its
+        // requests until the window comes back
+        int pixelWidth, pixelHeight;
+        SDL_GetWindowSizeInPixels(window, &pixelWidth, &pixelHeight);
+        bool nowHidden = (SDL_GetWindowFlags(window) & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN | SDL_WINDOW_OCCLUDED)) != 0 ||
+                         pixelWidth == 0 || pixelHeight == 0;
+        bool visibilityChanged = nowHidden != hidden;
+        if (visibilityChanged) {
+            hidden = nowHidden;
+            if (!hidden) {
+                resizeSerial++; // The size may have changed while we were away
             }
+        } else if (hidden) {
+            frameRequested = false;
+            continue;
         }
 
-        // Start ImGui frame
-        ImGui_ImplVulkan_NewFrame();
-        ImGui_ImplSDL3_NewFrame();
-        igNewFrame();
-
-        // ImGui interface
-        igBegin("Controls", NULL, 0);
-        igCheckbox("Show Triangle", &showTriangle);
-        igCheckbox("Show Quad", &showQuad);
-        igEnd();
-        igRender();
-
-        VulkanContext* vkCtx = get_vulkan_context();
-
-        // Acquire next image
-        uint32_t imageIndex;
-        VkResult result = vkAcquireNextImageKHR(vkCtx->device, vkCtx->swapchain, UINT64_MAX,
-                                                vkCtx->imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-            recreate_swapchain(window);
+        // Answer the render thread's request, unless on demand and nothing has changed: then it
+        // stays parked and the display keeps showing the last presented image. Visibility changes
+        // are published right away, the render thread may be parked.
+        render_get_stats(&stats);
+        bool redraw = !onDemand || redrawFrames > 0 || stats.animating || meshChurn > 0;
+        if (!visibilityChanged && (!frameRequested || !redraw)) {
             continue;
-        } else if (result != VK_SUCCESS) {
-            printf("Failed to acquire swapchain image: %d\n", result);
-            exit(1);
+        }
+        frameRequested = false;
+        if (redrawFrames > 0) {
+            redrawFrames--;
         }
 
-        // Wait for the fence associated with this imageIndex
-        vkWaitForFences(vkCtx->device, 1, &vkCtx->inFlightFences[imageIndex], VK_TRUE, UINT64_MAX);
-        vkResetFences(vkCtx->device, 1, &vkCtx->inFlightFences[imageIndex]);
+        arena_frame_begin();
+        heap_frame_end();
+        FrameSnapshot* snapshot = render_snapshot_begin();
+        snapshot->inputNs = SDL_GetTicksNS(); // Latency is measured from input sampling
+        snapshot->visible = !hidden;
+        if (!hidden) {
+            // Start ImGui frame
+            ImGui_ImplVulkan_NewFrame();
+            ImGui_ImplSDL3_NewFrame();
+            igNewFrame();
 
-        // Reset command buffer
-        if (vkResetCommandBuffer(vkCtx->commandBuffers[imageIndex], 0) != VK_SUCCESS) {
-            printf("Failed to reset command buffer\n");
-            exit(1);
-        }
+            // ImGui interface
+            igBegin("Controls", NULL, 0);
+            igCheckbox("Show Triangle", &showTriangle);
+            igCheckbox("Show Quad", &showQuad);
+            igCheckbox("Render on demand", &onDemand);
+            igText("Frame %llu submitted, %llu completed (%s)", (unsigned long long)stats.submittedFrame,
+                   (unsigned long long)stats.completedFrame, stats.timelineSupported ? "timeline" : "fences");
 
-        // Record command buffer
-        vulkan_begin_render(imageIndex);
-        if (showTriangle) {
-            render_triangle(vkCtx->commandBuffers[imageIndex]);
-        }
-        if (showQuad) {
-            render_quad(vkCtx->commandBuffers[imageIndex]);
+            // Present mode and buffering, applied by the render thread before its next acquire
+            const char* presentModeNames[MAX_PRESENT_MODES];
+            int presentModeIndex = 0;
+            for (uint32_t i = 0; i < stats.presentModeCount; i++) {
+                presentModeNames[i] = vulkan_present_mode_name(stats.presentModes[i]);
+                if (stats.presentModes[i] == presentMode) {
+                    presentModeIndex = (int)i;
+                }
+            }
+            if (igCombo_Str_arr("Present mode", &presentModeIndex, presentModeNames, (int)stats.presentModeCount, -1)) {
+                presentMode = stats.presentModes[presentModeIndex];
+            }
+            igRadioButton_IntPtr("Double buffering", &bufferedImages, 2);
+            igSameLine(0.0f, -1.0f);
+            igRadioButton_IntPtr("Triple buffering", &bufferedImages, 3);
+            igText("Swapchain: %u images, %ux%u, %.1f FPS", stats.imageCount, stats.width, stats.height, igGetIO()->Framerate);
+            igText("Render thread: blocked %.2f ms in acquire/present, %llu stale frames", stats.stallMs,
+                   (unsigned long long)stats.staleFrames);
+            // Command recording: inline, or secondaries recorded on the worker pool
+            igCheckbox("Parallel recording", &parallelRecording);
+            igCheckbox("Cache static draws", &cacheStatic);
+            igSliderInt("Record threads", &recordWorkers, 1, (int)stats.record.workerCount, "%d", 0);
+            igSliderInt("Grid draws", &gridDraws, 0, 50000, "%d", 0);
+            igSliderInt("Instanced quads", &quadInstances, 0, 1000000, "%d", 0); // One draw call, see the encoder's draw count
+            igCheckbox("GPU culling", &gpuCulling);
+            if (gpuCulling) {
+                igSliderFloat("Cull region", &cullRegion, 0.1f, 1.0f, "%.2f", 0);
+                igText("GPU cull: %u of %u quads visible", stats.cull.visible, stats.cull.instances);
+            }
+            igText("Recording: %.2f ms, %u secondaries on %u threads", stats.recordMs,
+                   parallelRecording ? stats.record.lastJobs : 0, parallelRecording ? stats.record.activeWorkers : 1);
+            igText("Static cache: recorded %u times, last %.2f ms", stats.staticRecords, stats.staticRecordMs);
+            if (stats.scaledRenderSupported) {
+                igSliderFloat("Render scale", &renderScale, 0.25f, 1.0f, "%.2f", 0);
+            }
+            igText("Graph: %u passes (%u culled), %u render passes, %u barriers", stats.graph.passes,
+                   stats.graph.culledPasses, stats.graph.renderPasses, stats.graph.barriers);
+            igText("Transient images: %u in %.1f MB (%.1f MB aliased)", stats.graph.transientImages,
+                   stats.graph.transientBytes / (1024.0 * 1024.0), stats.graph.aliasedBytes / (1024.0 * 1024.0));
+            igText("Encoder: %u calls issued, %u elided", stats.encoder.totalIssued, stats.encoder.totalSkipped);
+            for (uint32_t i = 0; i < ENCODER_CALL_DRAW; i++) {
+                igText("  %-11s %6u issued, %6u elided", encoder_call_name((EncoderCall)i), stats.encoder.issued[i], stats.encoder.skipped[i]);
+            }
+            if (igButton("Benchmark recording", (ImVec2){0, 0})) {
+                benchmarkSerial++;
+            }
+            for (uint32_t i = 0; i < stats.benchmark.threadCount; i++) {
+                igText("%u draws, %2u threads: %.3f ms (x%.2f)", stats.benchmark.drawCount, i + 1, stats.benchmark.ms[i],
+                       stats.benchmark.ms[0] / stats.benchmark.ms[i]);
+            }
+            igCheckbox("Low-latency pacing", &lowLatency);
+            igText("Pacer (%s): refresh %.2f ms, cpu %.2f ms, slept %.2f ms, oversleep %.3f ms",
+                   stats.pacer.presentWait ? "present wait" : "sleep", stats.pacer.refreshMs, stats.pacer.cpuFrameMs,
+                   stats.pacer.sleptMs, stats.pacer.oversleepMs);
+            igText("%s latency: frame %llu %.2f ms (avg %.2f ms)", stats.pacer.presentWait ? "Display" : "GPU",
+                   (unsigned long long)stats.pacer.latencyFrame, stats.pacer.latencyMs, stats.pacer.averageLatencyMs);
+            for (uint32_t i = 0; i < stats.presentModeCount; i++) {
+                for (uint32_t b = 0; b <= MAX_BUFFERED_IMAGES - MIN_BUFFERED_IMAGES; b++) {
+                    const FrameLatency* latency = &stats.presentLatency[i][b];
+                    if (latency->samples > 0) {
+                        igText("%-12s x%u latency %.2f ms (avg %.2f ms over %llu frames)", presentModeNames[i], b + MIN_BUFFERED_IMAGES,
+                               latency->lastMs, latency->averageMs, (unsigned long long)latency->samples);
+                    }
+                }
+            }
+            igEnd();
+
+            // GPU memory usage, as of the render thread's last frame
+            const MemoryStats* memStats = &stats.memory;
+            igBegin("Memory", NULL, 0);
+            igText("Blocks: %u  Allocations: %u  Budget ext: %s", memStats->blockCount, memStats->allocationCount,
+                   memStats->budgetSupported ? "yes" : "no");
+            for (uint32_t i = 0; i < memStats->heapCount; i++) {
+                igText("Heap %u: %.1f / %.1f MB (blocks %.1f MB, used %.1f MB)", i,
+                       memStats->heapUsage[i] / (1024.0 * 1024.0), memStats->heapBudget[i] / (1024.0 * 1024.0),
+                       memStats->blockBytes[i] / (1024.0 * 1024.0), memStats->allocatedBytes[i] / (1024.0 * 1024.0));
+            }
+            for (uint32_t i = 0; i < MEMORY_TAG_COUNT; i++) {
+                igText("%-9s %8.1f KB in %u", memory_tag_name((MemoryTag)i), memStats->tagBytes[i] / 1024.0, memStats->tagAllocations[i]);
+            }
+            if (memStats->overBudget) {
+                igText("OVER BUDGET");
+            }
+            ArenaStats arenaStats;
+            arena_get_stats(&arenaStats);
+            igText("Deferred destroys pending: %u", stats.deferPending);
+            igText("Heap allocations last frame: %u (steady for %u frames)", arenaStats.lastFrameHeapAllocations, arenaStats.steadyFrames);
+            ThreadArenaStats mainArena;
+            arena_get_thread_stats(&mainArena);
+            igText("Arena peak: main frame %zu KB, scratch %zu KB; render frame %zu KB, scratch %zu KB",
+                   mainArena.framePeak / 1024, mainArena.scratchPeak / 1024,
+                   stats.arena.framePeak / 1024, stats.arena.scratchPeak / 1024);
+            igText("Geometry: %u meshes, fragmentation vertex %.1f%% index %.1f%%", stats.geometry.meshCount,
+                   stats.geometry.vertexFragmentation * 100.0f, stats.geometry.indexFragmentation * 100.0f);
+            igText("Geometry pools: vertex %.1f MB in %u blocks, index %.1f MB in %u, %.1f MB released",
+                   stats.geometry.vertexPoolBytes / (1024.0 * 1024.0), stats.geometry.vertexBlocks,
+                   stats.geometry.indexPoolBytes / (1024.0 * 1024.0), stats.geometry.indexBlocks,
+                   stats.geometry.releasedBytes / (1024.0 * 1024.0));
+            igSliderInt("Mesh churn", &meshChurn, 0, 16, "%d", 0); // Meshes replaced per frame
+            if (stats.geometry.defragActive) {
+                igText("Defragmenting...");
+            } else if (igButton("Defragment", (ImVec2){0, 0})) {
+                defragSerial++;
+            }
+            igEnd();
+            igRender();
+
+            imgui_queue_textures(stats.imguiTextureSerial);
+            imgui_snapshot_capture(&snapshot->imgui);
         }
-        render_imgui(imageIndex);
-        vulkan_end_render(imageIndex, currentFrame);
+        snapshot->showTriangle = showTriangle;
+        snapshot->showQuad = showQuad;
+        snapshot->lowLatency = lowLatency;
+        snapshot->onDemand = onDemand;
+        snapshot->presentMode = presentMode;
+        snapshot->bufferedImages = (uint32_t)bufferedImages;
+        snapshot->resizeSerial = resizeSerial;
+        snapshot->defragSerial = defragSerial;
+        snapshot->parallelRecording = parallelRecording;
+        snapshot->cacheStatic = cacheStatic;
+        snapshot->recordWorkers = (uint32_t)recordWorkers;
+        snapshot->gridDraws = (uint32_t)gridDraws;
+        snapshot->quadInstances = (uint32_t)quadInstances;
+        snapshot->meshChurn = (uint32_t)meshChurn;
+        snapshot->gpuCulling = gpuCulling;
+        snapshot->cullRegion = cullRegion;
+        snapshot->renderScale = renderScale;
+        snapshot->benchmarkSerial = benchmarkSerial;
+        render_snapshot_publish();
 
-        // Increment frame index
-        currentFrame = (currentFrame + 1) % vkCtx->imageCount;
+        alloc_tick();
     }
 
     // Cleanup
-    VulkanContext* vkCtx = get_vulkan_context();
+    render_thread_stop(); // Vulkan is ours again
     vkDeviceWaitIdle(vkCtx->device);
+    imgui_destroy_textures();
     ImGui_ImplVulkan_Shutdown();
     ImGui_ImplSDL3_Shutdown();
     igDestroyContext(NULL);
     cleanup_vulkan();
+    alloc_dump(); // Anything still live here is leaked by the driver or by us
     SDL_DestroyWindow(window);
     SDL_Quit();
+    cleanup_arenas();
     return 0;
 }
 
@@ -0,0 +1,528 @@
+#include "memory_module.h"
+#include "vulkan_module.h"
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMORY_BLOCK_SIZE (64ull * 1024 * 1024) // Default VkDeviceMemory block size
+#define MEMORY_MAX_BLOCKS 256
+
+typedef struct {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+    uint32_t allocationCount;
+    void* mapped; // Persistently mapped when host visible
+    RangeAllocator ranges;
+} MemoryBlock;
+
+typedef struct {
+    MemoryBlock blocks[MEMORY_MAX_BLOCKS];
+    uint32_t blockCount;
+    VkDeviceSize bufferImageGranularity;
+    uint32_t maxAllocationCount;
+    uint32_t deviceAllocationCount;
+
+    // Usage tracking
+    VkDeviceSize heapBlockBytes[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapAllocatedBytes[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize tagBytes[MEMORY_TAG_COUNT];
+    uint32_t tagAllocations[MEMORY_TAG_COUNT];
+    VkDeviceSize heapBudget[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS];
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2;
+} MemoryContext;
+
+static MemoryContext memCtx = {0};
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return alignment > 1 ? (value + alignment - 1) & ~(alignment - 1) : value;
+}
+
+//================================================
+// Range allocator
+//================================================
+
+void range_allocator_init(RangeAllocator* ra, VkDeviceSize capacity) {
+    ra->capacity = capacity;
+    ra->used = 0;
+    ra->freeCapacity = 16;
+    ra->freeRanges = heap_alloc(ra->freeCapacity * sizeof(MemoryRange));
+    ra->freeRanges[0].offset = 0;
+    ra->freeRanges[0].size = capacity;
+    ra->freeCount = 1;
+}
+
+void range_allocator_destroy(RangeAllocator* ra) {
+    heap_free(ra->freeRanges);
+    memset(ra, 0, sizeof(*ra));
+}
+
+static void range_insert_at(RangeAllocator* ra, uint32_t index, VkDeviceSize offset, VkDeviceSize size) {
+    if (ra->freeCount == ra->freeCapacity) {
+        ra->freeCapacity *= 2;
+        ra->freeRanges = heap_realloc(ra->freeRanges, ra->freeCapacity * sizeof(MemoryRange));
+    }
+    memmove(&ra->freeRanges[index + 1], &ra->freeRanges[index], (ra->freeCount - index) * sizeof(MemoryRange));
+    ra->freeRanges[index].offset = offset;
+    ra->freeRanges[index].size = size;
+    ra->freeCount++;
+}
+
+static void range_remove_at(RangeAllocator* ra, uint32_t index) {
+    memmove(&ra->freeRanges[index], &ra->freeRanges[index + 1], (ra->freeCount - index - 1) * sizeof(MemoryRange));
+    ra->freeCount--;
+}
+
+VkBool32 range_allocator_alloc(RangeAllocator* ra, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset) {
+    for (uint32_t i = 0; i < ra->freeCount; i++) {
+        MemoryRange range = ra->freeRanges[i];
+        VkDeviceSize aligned = align_up(range.offset, alignment);
+        if (aligned + size > range.offset + range.size) {
+            continue;
+        }
+
+        // Split the free range into [padding][allocation][tail]
+        VkDeviceSize padding = aligned - range.offset;
+        VkDeviceSize tail = range.offset + range.size - (aligned + size);
+        range_remove_at(ra, i);
+        if (tail > 0) {
+            range_insert_at(ra, i, aligned + size, tail);
+        }
+        if (padding > 0) {
+            range_insert_at(ra, i, range.offset, padding);
+        }
+
+        ra->used += size;
+        *offset = aligned;
+        return VK_TRUE;
+    }
+    return VK_FALSE;
+}
+
+void range_allocator_free(RangeAllocator* ra, VkDeviceSize offset, VkDeviceSize size) {
+    // Binary search for the first free range after offset
+    uint32_t lo = 0, hi = ra->freeCount;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (ra->freeRanges[mid].offset < offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    ra->used -= size;
+
+    // Coalesce with neighbours
+    VkBool32 mergePrev = lo > 0 && ra->freeRanges[lo - 1].offset + ra->freeRanges[lo - 1].size == offset;
+    VkBool32 mergeNext = lo < ra->freeCount && offset + size == ra->freeRanges[lo].offset;
+    if (mergePrev && mergeNext) {
+        ra->freeRanges[lo - 1].size += size + ra->freeRanges[lo].size;
+        range_remove_at(ra, lo);
+    } else if (mergePrev) {
+        ra->freeRanges[lo - 1].size += size;
+    } else if (mergeNext) {
+        ra->freeRanges[lo].offset = offset;
+        ra->freeRanges[lo].size += size;
+    } else {
+        range_insert_at(ra, lo, offset, size);
+    }
+}
+
+VkDeviceSize range_allocator_largest_free(const RangeAllocator* ra) {
+    VkDeviceSize largest = 0;
+    for (uint32_t i = 0; i < ra->freeCount; i++) {
+        if (ra->freeRanges[i].size > largest) {
+            largest = ra->freeRanges[i].size;
+        }
+    }
+    return largest;
+}
+
+//================================================
+// Device memory blocks
+//================================================
+
+static uint32_t heap_of_type(uint32_t memoryTypeIndex) {
+    return get_vulkan_context()->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+}
+
+// Refresh heapBudget/heapUsage, from VK_EXT_memory_budget when available
+static void refresh_budget(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    const VkPhysicalDeviceMemoryProperties* memProperties = &vkCtx->memoryProperties;
+
+    if (vkCtx->memoryBudgetSupported && memCtx.getMemoryProperties2) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+        VkPhysicalDeviceMemoryProperties2 properties2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2};
+        properties2.pNext = &budget;
+        memCtx.getMemoryProperties2(vkCtx->physicalDevice, &properties2);
+        for (uint32_t i = 0; i < memProperties->memoryHeapCount; i++) {
+            memCtx.heapBudget[i] = budget.heapBudget[i];
+            memCtx.heapUsage[i] = budget.heapUsage[i];
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < memProperties->memoryHeapCount; i++) {
+        memCtx.heapBudget[i] = memProperties->memoryHeaps[i].size / 10 * 8;
+        memCtx.heapUsage[i] = memCtx.heapBlockBytes[i];
+    }
+}
+
+static VkDeviceSize block_size_for_type(uint32_t memoryTypeIndex) {
+    VulkanContext* vkCtx = get_vulkan_context();
+
+    // Keep small heaps (e.g. 256MB BAR) from being eaten by one block
+    VkDeviceSize heapSize = vkCtx->memoryProperties.memoryHeaps[heap_of_type(memoryTypeIndex)].size;
+    VkDeviceSize blockSize = MEMORY_BLOCK_SIZE;
+    if (heapSize / 8 < blockSize) {
+        blockSize = align_up(heapSize / 8, 1024 * 1024);
+    }
+    return blockSize;
+}
+
+static uint32_t create_block(uint32_t memoryTypeIndex, VkDeviceSize size) {
+    VulkanContext* vkCtx = get_vulkan_context();
+
+    // Reuse an empty slot left behind by a released block
+    uint32_t index = memCtx.blockCount;
+    for (uint32_t i = 0; i < memCtx.blockCount; i++) {
+        if (memCtx.blocks[i].memory == VK_NULL_HANDLE) {
+            index = i;
+            break;
+        }
+    }
+    if (index == MEMORY_MAX_BLOCKS) {
+        printf("Out of memory blocks (max %d)\n", MEMORY_MAX_BLOCKS);
+        exit(1);
+    }
+    if (memCtx.deviceAllocationCount >= memCtx.maxAllocationCount) {
+        printf("Reached maxMemoryAllocationCount (%u)\n", memCtx.maxAllocationCount);
+        exit(1);
+    }
+
+    uint32_t heapIndex = heap_of_type(memoryTypeIndex);
+    refresh_budget();
+    if (memCtx.heapUsage[heapIndex] + size > memCtx.heapBudget[heapIndex]) {
+        printf("Warning: heap %u over budget (%llu + %llu > %llu bytes)\n", heapIndex,
+               (unsigned long long)memCtx.heapUsage[heapIndex], (unsigned long long)size,
+               (unsigned long long)memCtx.heapBudget[heapIndex]);
+    }
+
+    MemoryBlock* block = &memCtx.blocks[index];
+    VkMemoryAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+    if (vkAllocateMemory(vkCtx->device, &allocInfo, vk_allocator(ALLOC_OBJECT_MEMORY), &block->memory) != VK_SUCCESS) {
+        printf("Failed to allocate memory block (%llu bytes)\n", (unsigned long long)size);
+        exit(1);
+    }
+
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->allocationCount = 0;
+    block->mapped = NULL;
+    range_allocator_init(&block->ranges, size);
+
+    if (vkCtx->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        vkMapMemory(vkCtx->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+    }
+
+    memCtx.heapBlockBytes[heapIndex] += size;
+    memCtx.deviceAllocationCount++;
+    if (index == memCtx.blockCount) {
+        memCtx.blockCount++;
+    }
+    return index;
+}
+
+static void destroy_block(uint32_t index) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    MemoryBlock* block = &memCtx.blocks[index];
+    if (block->memory == VK_NULL_HANDLE) {
+        return;
+    }
+    if (block->mapped) {
+        vkUnmapMemory(vkCtx->device, block->memory);
+    }
+    vkFreeMemory(vkCtx->device, block->memory, vk_allocator(ALLOC_OBJECT_MEMORY));
+    memCtx.heapBlockBytes[heap_of_type(block->memoryTypeIndex)] -= block->size;
+    range_allocator_destroy(&block->ranges);
+    memset(block, 0, sizeof(*block));
+    memCtx.deviceAllocationCount--;
+}
+
+void init_memory(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    memset(&memCtx, 0, sizeof(memCtx));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkCtx->physicalDevice, &properties);
+    memCtx.bufferImageGranularity = properties.limits.bufferImageGranularity;
+    memCtx.maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+    if (vkCtx->memoryBudgetSupported) {
+        memCtx.getMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(vkCtx->instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+    }
+    refresh_budget();
+}
+
+void cleanup_memory(void) {
+    for (uint32_t i = 0; i < memCtx.blockCount; i++) {
+        if (memCtx.blocks[i].allocationCount > 0) {
+            printf("Memory block %u still has %u live allocations\n", i, memCtx.blocks[i].allocationCount);
+        }
+        destroy_block(i);
+    }
+    memCtx.blockCount = 0;
+}
+
+VkDeviceSize memory_trim(void) {
+    VkDeviceSize released = 0;
+    for (uint32_t i = 0; i < memCtx.blockCount; i++) {
+        if (memCtx.blocks[i].memory != VK_NULL_HANDLE && memCtx.blocks[i].allocationCount == 0) {
+            released += memCtx.blocks[i].size;
+            destroy_block(i);
+        }
+    }
+    return released;
+}
+
+void memory_allocate(const VkMemoryRequirements* requirements, VkMemoryPropertyFlags properties, MemoryTag tag, MemoryAllocation* allocation) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    uint32_t memoryTypeIndex = find_memory_type(vkCtx, requirements->memoryTypeBits, properties);
+
+    // Aligning to the granularity lets buffers and optimal images share a block safely
+    VkDeviceSize alignment = requirements->alignment;
+    if (alignment < memCtx.bufferImageGranularity) {
+        alignment = memCtx.bufferImageGranularity;
+    }
+
+    VkDeviceSize offset = 0;
+    uint32_t blockIndex = UINT32_MAX;
+    for (uint32_t i = 0; i < memCtx.blockCount; i++) {
+        MemoryBlock* block = &memCtx.blocks[i];
+        if (block->memory != VK_NULL_HANDLE && block->memoryTypeIndex == memoryTypeIndex &&
+            range_allocator_alloc(&block->ranges, requirements->size, alignment, &offset)) {
+            blockIndex = i;
+            break;
+        }
+    }
+
+    if (blockIndex == UINT32_MAX) {
+        // Oversized requests get a block of their own
+        VkDeviceSize blockSize = block_size_for_type(memoryTypeIndex);
+        if (requirements->size > blockSize / 2) {
+            blockSize = align_up(requirements->size, alignment);
+        }
+        blockIndex = create_block(memoryTypeIndex, blockSize);
+        if (!range_allocator_alloc(&memCtx.blocks[blockIndex].ranges, requirements->size, alignment, &offset)) {
+            printf("Failed to sub-allocate %llu bytes\n", (unsigned long long)requirements->size);
+            exit(1);
+        }
+    }
+
+    MemoryBlock* block = &memCtx.blocks[blockIndex];
+    block->allocationCount++;
+    memCtx.heapAllocatedBytes[heap_of_type(memoryTypeIndex)] += requirements->size;
+    memCtx.tagBytes[tag] += requirements->size;
+    memCtx.tagAllocations[tag]++;
+
+    allocation->memory = block->memory;
+    allocation->offset = offset;
+    allocation->size = requirements->size;
+    allocation->memoryTypeIndex = memoryTypeIndex;
+    allocation->blockIndex = blockIndex;
+    allocation->tag = tag;
+    allocation->mapped = block->mapped ? (char*)block->mapped + offset : NULL;
+}
+
+void memory_free(MemoryAllocation* allocation) {
+    if (allocation->memory == VK_NULL_HANDLE) {
+        return;
+    }
+    MemoryBlock* block = &memCtx.blocks[allocation->blockIndex];
+    range_allocator_free(&block->ranges, allocation->offset, allocation->size);
+    block->allocationCount--;
+    memCtx.heapAllocatedBytes[heap_of_type(allocation->memoryTypeIndex)] -= allocation->size;
+    memCtx.tagBytes[allocation->tag] -= allocation->size;
+    memCtx.tagAllocations[allocation->tag]--;
+    // Empty blocks stay cached for reuse; memory_trim or cleanup_memory releases them
+    memset(allocation, 0, sizeof(*allocation));
+}
+
+void memory_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryTag tag, VkBuffer* buffer, MemoryAllocation* allocation) {
+    VulkanContext* vkCtx = get_vulkan_context();
+
+    VkBufferCreateInfo bufferInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(vkCtx->device, &bufferInfo, vk_allocator(ALLOC_OBJECT_BUFFER), buffer) != VK_SUCCESS) {
+        printf("Failed to create buffer\n");
+        exit(1);
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(vkCtx->device, *buffer, &memRequirements);
+    memory_allocate(&memRequirements, properties, tag, allocation);
+
+    if (vkBindBufferMemory(vkCtx->device, *buffer, allocation->memory, allocation->offset) != VK_SUCCESS) {
+        printf("Failed to bind buffer memory\n");
+        exit(1);
+    }
+}
+
+void memory_destroy_buffer(VkBuffer* buffer, MemoryAllocation* allocation) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (*buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(vkCtx->device, *buffer, vk_allocator(ALLOC_OBJECT_BUFFER));
+        *buffer = VK_NULL_HANDLE;
+    }
+    memory_free(allocation);
+}
+
+//================================================
+// Budget and statistics
+//================================================
+
+VkBool32 memory_heap_has_headroom(uint32_t heapIndex) {
+    return memCtx.heapUsage[heapIndex] < memCtx.heapBudget[heapIndex];
+}
+
+void memory_get_stats(MemoryStats* stats) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    memset(stats, 0, sizeof(*stats));
+    refresh_budget();
+
+    stats->heapCount = vkCtx->memoryProperties.memoryHeapCount;
+    stats->budgetSupported = vkCtx->memoryBudgetSupported;
+    for (uint32_t i = 0; i < stats->heapCount; i++) {
+        stats->heapSize[i] = vkCtx->memoryProperties.memoryHeaps[i].size;
+        stats->heapBudget[i] = memCtx.heapBudget[i];
+        stats->heapUsage[i] = memCtx.heapUsage[i];
+        stats->blockBytes[i] = memCtx.heapBlockBytes[i];
+        stats->allocatedBytes[i] = memCtx.heapAllocatedBytes[i];
+        if (stats->heapUsage[i] > stats->heapBudget[i]) {
+            stats->overBudget = VK_TRUE;
+        }
+    }
+    for (uint32_t i = 0; i < MEMORY_TAG_COUNT; i++) {
+        stats->tagBytes[i] = memCtx.tagBytes[i];
+        stats->tagAllocations[i] = memCtx.tagAllocations[i];
+        stats->allocationCount += memCtx.tagAllocations[i];
+    }
+    stats->blockCount = memCtx.deviceAllocationCount;
+}
+
+const char* memory_tag_name(MemoryTag tag) {
+    switch (tag) {
+        case MEMORY_TAG_GEOMETRY: return "geometry";
+        case MEMORY_TAG_FONT: return "font";
+        case MEMORY_TAG_IMGUI: return "imgui";
+        case MEMORY_TAG_STAGING: return "staging";
+        case MEMORY_TAG_ATTACHMENT: return "attachment";
+        default: return "other";
+    }
+}
+
+//================================================
+// Benchmark
+//================================================
+
+static double best_ns_per_pair(uint64_t best, uint32_t count) {
+    return count > 0 ? (double)best / count : 0.0;
+}
+
+void memory_benchmark(MemoryBenchmark* result) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    uint32_t count = MEMORY_BENCHMARK_ALLOCATIONS;
+    memset(result, 0, sizeof(*result));
+    result->allocationCount = count;
+
+    // Leave room for blocks the rest of the app may still need
+    uint32_t deviceCount = memCtx.maxAllocationCount - memCtx.deviceAllocationCount;
+    deviceCount = deviceCount > 64 ? deviceCount - 64 : 0;
+    result->deviceCount = deviceCount < count ? deviceCount : count;
+
+    // Blocks that already exist belong to the app; only the ones created here are released afterwards
+    VkBool32 existing[MEMORY_MAX_BLOCKS];
+    for (uint32_t i = 0; i < MEMORY_MAX_BLOCKS; i++) {
+        existing[i] = memCtx.blocks[i].memory != VK_NULL_HANDLE;
+    }
+
+    ScratchScope scratch = scratch_begin();
+    VkDeviceSize* offsets = scratch_alloc(count * sizeof(VkDeviceSize));
+    MemoryAllocation* allocations = scratch_alloc(count * sizeof(MemoryAllocation));
+    VkDeviceMemory* memories = scratch_alloc(count * sizeof(VkDeviceMemory));
+
+    VkMemoryRequirements requirements = {0};
+    requirements.size = MEMORY_BENCHMARK_SIZE;
+    requirements.alignment = 256;
+    requirements.memoryTypeBits = UINT32_MAX;
+    uint32_t memoryTypeIndex = find_memory_type(vkCtx, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    uint64_t bestRange = UINT64_MAX;
+    uint64_t bestSubAllocate = UINT64_MAX;
+    uint64_t bestDevice = UINT64_MAX;
+    for (uint32_t run = 0; run < MEMORY_BENCHMARK_RUNS; run++) {
+        RangeAllocator ranges;
+        range_allocator_init(&ranges, (VkDeviceSize)count * MEMORY_BENCHMARK_SIZE);
+        uint64_t start = SDL_GetTicksNS();
+        for (uint32_t i = 0; i < count; i++) {
+            range_allocator_alloc(&ranges, MEMORY_BENCHMARK_SIZE, requirements.alignment, &offsets[i]);
+        }
+        for (uint32_t pass = 0; pass < 2; pass++) {
+            for (uint32_t i = pass; i < count; i += 2) {
+                range_allocator_free(&ranges, offsets[i], MEMORY_BENCHMARK_SIZE);
+            }
+        }
+        uint64_t elapsed = SDL_GetTicksNS() - start;
+        bestRange = elapsed < bestRange ? elapsed : bestRange;
+        range_allocator_destroy(&ranges);
+
+        start = SDL_GetTicksNS();
+        for (uint32_t i = 0; i < count; i++) {
+            memory_allocate(&requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_TAG_OTHER, &allocations[i]);
+        }
+        for (uint32_t pass = 0; pass < 2; pass++) {
+            for (uint32_t i = pass; i < count; i += 2) {
+                memory_free(&allocations[i]);
+            }
+        }
+        elapsed = SDL_GetTicksNS() - start;
+        bestSubAllocate = elapsed < bestSubAllocate ? elapsed : bestSubAllocate;
+
+        VkMemoryAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+        allocInfo.allocationSize = MEMORY_BENCHMARK_SIZE;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+        uint32_t allocated = 0;
+        start = SDL_GetTicksNS();
+        while (allocated < result->deviceCount &&
+               vkAllocateMemory(vkCtx->device, &allocInfo, vk_allocator(ALLOC_OBJECT_MEMORY), &memories[allocated]) == VK_SUCCESS) {
+            allocated++;
+        }
+        for (uint32_t pass = 0; pass < 2; pass++) {
+            for (uint32_t i = pass; i < allocated; i += 2) {
+                vkFreeMemory(vkCtx->device, memories[i], vk_allocator(ALLOC_OBJECT_MEMORY));
+            }
+        }
+        elapsed = SDL_GetTicksNS() - start;
+        bestDevice = elapsed < bestDevice ? elapsed : bestDevice;
+        result->deviceCount = allocated; // The driver may refuse before the limit
+    }
+
+    result->rangeNs = best_ns_per_pair(bestRange, count);
+    result->subAllocateNs = best_ns_per_pair(bestSubAllocate, count);
+    result->deviceNs = best_ns_per_pair(bestDevice, result->deviceCount);
+    printf("Memory benchmark, %u x %u KB: range allocator %.0f ns, memory_allocate %.0f ns, vkAllocateMemory %.0f ns (%u) per alloc+free\n",
+           count, MEMORY_BENCHMARK_SIZE / 1024, result->rangeNs, result->subAllocateNs, result->deviceNs, result->deviceCount);
+
+    scratch_end(scratch);
+    for (uint32_t i = 0; i < MEMORY_MAX_BLOCKS; i++) {
+        if (!existing[i] && memCtx.blocks[i].memory != VK_NULL_HANDLE && memCtx.blocks[i].allocationCount == 0) {
+            destroy_block(i);
+        }
+    }
+}
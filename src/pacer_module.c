@@ -0,0 +1,191 @@
+#include "pacer_module.h"
+#include "vulkan_module.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PACER_DEFAULT_REFRESH_NS 16666667.0
+
+typedef struct {
+    PFN_vkWaitForPresentKHR waitForPresent; // NULL without VK_KHR_present_wait
+    VkBool32 enabled;
+
+    // Per frame, indexed by frame % PACER_HISTORY
+    uint64_t startTimes[PACER_HISTORY];
+    VkSwapchainKHR swapchains[PACER_HISTORY]; // Present ids are only meaningful per swapchain
+    uint64_t recordedFrame; // Newest submitted frame
+    uint64_t measuredFrame; // Newest frame whose latency is known (or given up on)
+
+    uint64_t lastDisplayNs; // When measuredFrame reached the display / finished
+    uint64_t nextDeadlineNs;
+    double refreshNs;
+    double cpuFrameNs;
+    double oversleepNs;
+    double sleptNs;
+    double latencyNs;
+    double averageLatencyNs;
+    uint64_t latencySamples;
+    uint64_t latencyFrame;
+} PacerContext;
+
+static PacerContext pacerCtx = {0};
+
+void init_pacer(SDL_Window* window) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    memset(&pacerCtx, 0, sizeof(pacerCtx));
+
+    if (vkCtx->presentWaitSupported) {
+        pacerCtx.waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(vkCtx->device, "vkWaitForPresentKHR");
+    }
+
+    // Starting point only; present-wait timings refine it
+    const SDL_DisplayMode* mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+    pacerCtx.refreshNs = (mode && mode->refresh_rate > 0.0f) ? 1000000000.0 / mode->refresh_rate : PACER_DEFAULT_REFRESH_NS;
+    printf("Frame pacer: %s, refresh %.2f ms\n", pacerCtx.waitForPresent ? "present wait" : "calibrated sleep",
+           pacerCtx.refreshNs / 1000000.0);
+}
+
+void pacer_set_enabled(VkBool32 enabled) {
+    if (pacerCtx.enabled == enabled) {
+        return;
+    }
+    pacerCtx.enabled = enabled;
+    pacerCtx.averageLatencyNs = 0.0;
+    pacerCtx.latencySamples = 0;
+    pacerCtx.nextDeadlineNs = 0;
+}
+
+static void measure_frame(uint64_t frame, uint64_t now) {
+    if (pacerCtx.lastDisplayNs != 0 && frame == pacerCtx.measuredFrame + 1 && pacerCtx.waitForPresent) {
+        // Back-to-back presents land one refresh apart; ignore skipped or doubled vblanks
+        double delta = (double)(now - pacerCtx.lastDisplayNs);
+        if (delta > pacerCtx.refreshNs * 0.75 && delta < pacerCtx.refreshNs * 1.25) {
+            pacerCtx.refreshNs += (delta - pacerCtx.refreshNs) * 0.05;
+        }
+    }
+    double latency = (double)(now - pacerCtx.startTimes[frame % PACER_HISTORY]);
+    pacerCtx.latencyNs = latency;
+    pacerCtx.latencyFrame = frame;
+    pacerCtx.latencySamples++;
+    pacerCtx.averageLatencyNs += (latency - pacerCtx.averageLatencyNs) / (double)pacerCtx.latencySamples;
+    pacerCtx.measuredFrame = frame;
+    pacerCtx.lastDisplayNs = now;
+}
+
+// Collect finished presents; with block set, wait for the newest one to reach the display
+static VkBool32 measure_presents(VkBool32 block) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    VkBool32 newestDisplayed = VK_FALSE;
+    for (uint64_t frame = pacerCtx.measuredFrame + 1; frame <= pacerCtx.recordedFrame; frame++) {
+        VkSwapchainKHR swapchain = pacerCtx.swapchains[frame % PACER_HISTORY];
+        if (swapchain != vkCtx->swapchain) {
+            pacerCtx.measuredFrame = frame; // Presented to a retired swapchain, nothing to wait on
+            continue;
+        }
+        uint64_t timeout = (block && frame == pacerCtx.recordedFrame) ? (uint64_t)(pacerCtx.refreshNs * 2.0) : 0;
+        VkResult result = pacerCtx.waitForPresent(vkCtx->device, swapchain, frame, timeout);
+        if (result == VK_SUCCESS) {
+            measure_frame(frame, SDL_GetTicksNS());
+            newestDisplayed = frame == pacerCtx.recordedFrame;
+        } else if (result == VK_TIMEOUT && timeout == 0) {
+            break;
+        } else {
+            pacerCtx.measuredFrame = frame; // Timed out while blocking or out of date: don't wait on it again
+        }
+    }
+    return newestDisplayed;
+}
+
+// Without present wait the best we can observe is GPU completion
+static void measure_completions(VkBool32 block) {
+    if (block) {
+        vulkan_wait_frame(pacerCtx.recordedFrame);
+    }
+    uint64_t completed = vulkan_frame_completed();
+    uint64_t now = SDL_GetTicksNS();
+    for (uint64_t frame = pacerCtx.measuredFrame + 1; frame <= pacerCtx.recordedFrame && frame <= completed; frame++) {
+        measure_frame(frame, now);
+    }
+}
+
+// SDL_DelayNS overshoots by a platform-dependent amount; sleep short by the running
+// estimate and spin out the rest
+static void sleep_until(uint64_t target) {
+    uint64_t start = SDL_GetTicksNS();
+    if (target <= start) {
+        return;
+    }
+    uint64_t request = target - start;
+    if ((double)request > pacerCtx.oversleepNs) {
+        uint64_t sleep = request - (uint64_t)pacerCtx.oversleepNs;
+        SDL_DelayNS(sleep);
+        double overshoot = (double)(SDL_GetTicksNS() - start) - (double)sleep;
+        pacerCtx.oversleepNs += ((overshoot > 0.0 ? overshoot : 0.0) - pacerCtx.oversleepNs) * 0.1;
+    }
+    while (SDL_GetTicksNS() < target) {
+        // Sub-millisecond remainder, cheaper to spin than to oversleep
+    }
+}
+
+void pacer_wait(void) {
+    pacerCtx.sleptNs = 0.0;
+    if (pacerCtx.recordedFrame - pacerCtx.measuredFrame > PACER_HISTORY) {
+        pacerCtx.measuredFrame = pacerCtx.recordedFrame - PACER_HISTORY;
+    }
+
+    VkBool32 block = pacerCtx.enabled && pacerCtx.recordedFrame > pacerCtx.measuredFrame;
+    VkBool32 displayed = VK_FALSE;
+    if (pacerCtx.waitForPresent) {
+        displayed = measure_presents(block);
+    } else {
+        measure_completions(block);
+    }
+    if (!pacerCtx.enabled) {
+        return;
+    }
+
+    // Next deadline: one refresh after the last frame hit the display, else keep the cadence
+    uint64_t now = SDL_GetTicksNS();
+    uint64_t refresh = (uint64_t)pacerCtx.refreshNs;
+    if (displayed) {
+        pacerCtx.nextDeadlineNs = pacerCtx.lastDisplayNs + refresh;
+    } else if (pacerCtx.nextDeadlineNs == 0) {
+        pacerCtx.nextDeadlineNs = now + refresh;
+    } else {
+        pacerCtx.nextDeadlineNs += refresh;
+    }
+    while (pacerCtx.nextDeadlineNs < now) {
+        pacerCtx.nextDeadlineNs += refresh; // Missed vblanks are dropped, not caught up
+    }
+
+    uint64_t lead = (uint64_t)pacerCtx.cpuFrameNs + PACER_SAFETY_MARGIN_NS;
+    if (pacerCtx.nextDeadlineNs > now + lead) {
+        sleep_until(pacerCtx.nextDeadlineNs - lead);
+        pacerCtx.sleptNs = (double)(SDL_GetTicksNS() - now);
+    }
+}
+
+void pacer_frame_submitted(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    uint64_t frame = vulkan_frame_submitted();
+    if (frame == pacerCtx.recordedFrame) {
+        return;
+    }
+    pacerCtx.startTimes[frame % PACER_HISTORY] = vkCtx->frameStartNs;
+    pacerCtx.swapchains[frame % PACER_HISTORY] = vkCtx->swapchain;
+    pacerCtx.recordedFrame = frame;
+
+    double cpu = (double)(SDL_GetTicksNS() - vkCtx->frameStartNs);
+    pacerCtx.cpuFrameNs = pacerCtx.cpuFrameNs == 0.0 ? cpu : pacerCtx.cpuFrameNs + (cpu - pacerCtx.cpuFrameNs) * 0.1;
+}
+
+void pacer_get_stats(PacerStats* stats) {
+    stats->enabled = pacerCtx.enabled;
+    stats->presentWait = pacerCtx.waitForPresent != NULL;
+    stats->refreshMs = pacerCtx.refreshNs / 1000000.0;
+    stats->cpuFrameMs = pacerCtx.cpuFrameNs / 1000000.0;
+    stats->sleptMs = pacerCtx.sleptNs / 1000000.0;
+    stats->oversleepMs = pacerCtx.oversleepNs / 1000000.0;
+    stats->latencyMs = pacerCtx.latencyNs / 1000000.0;
+    stats->averageLatencyMs = pacerCtx.averageLatencyNs / 1000000.0;
+    stats->latencyFrame = pacerCtx.latencyFrame;
+}
@@ -0,0 +1,377 @@
+#include "record_module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECORD_BENCHMARK_RUNS 5 // Best of, per thread count
+
+typedef struct {
+    RecordJobFunc func; // NULL for secondaries added already recorded
+    void* userData;
+    uint32_t first;
+    uint32_t count;
+    VkCommandBuffer commandBuffer; // Filled in by whichever worker recorded it
+} RecordJob;
+
+// Command pools are externally synchronized, so every worker owns one per frame slot and
+// resets it whole once that slot's frame has completed
+typedef struct {
+    VkCommandPool pools[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer buffers[MAX_FRAMES_IN_FLIGHT][RECORD_MAX_JOBS];
+    uint32_t allocated[MAX_FRAMES_IN_FLIGHT];
+    uint32_t used; // Handed out from pools[frameIndex] this frame
+    SDL_Thread* thread;
+    SDL_Semaphore* start;
+} RecordWorker;
+
+typedef struct {
+    RecordWorker workers[RECORD_MAX_WORKERS];
+    uint32_t workerCount;
+    uint32_t activeWorkers;
+    uint32_t frameIndex;
+    VkFramebuffer framebuffer; // Inherited by this dispatch's secondaries, may be VK_NULL_HANDLE
+    VkExtent2D extent;         // Render area of the pass they execute in
+
+    RecordJob jobs[RECORD_MAX_JOBS];
+    uint32_t jobCount;
+    SDL_AtomicInt nextJob; // Workers claim jobs in queue order
+    SDL_AtomicInt quit;
+    SDL_Semaphore* done;   // One post per helper thread when the queue is drained
+
+    uint32_t lastJobs;
+    double lastRecordNs;
+} RecordContext;
+
+static RecordContext recCtx = {0};
+
+// Inherits the render pass; dynamic state and bindings are not inherited from the primary
+static void begin_secondary_buffer(CommandEncoder* encoder, VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, VkExtent2D extent, VkCommandBufferUsageFlags usage) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    VkCommandBufferInheritanceInfo inheritance = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+    inheritance.renderPass = vkCtx->renderPass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = framebuffer;
+    VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = usage | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        printf("Failed to begin secondary command buffer\n");
+        exit(1);
+    }
+
+    encoder_begin(encoder, commandBuffer);
+    VkViewport viewport = {0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f};
+    encoder_set_viewport(encoder, &viewport);
+    VkRect2D scissor = {{0, 0}, extent};
+    encoder_set_scissor(encoder, &scissor);
+}
+
+static void end_secondary_buffer(CommandEncoder* encoder) {
+    encoder_end(encoder);
+    if (vkEndCommandBuffer(encoder->commandBuffer) != VK_SUCCESS) {
+        printf("Failed to end secondary command buffer\n");
+        exit(1);
+    }
+}
+
+static void begin_secondary(RecordWorker* worker, CommandEncoder* encoder) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    uint32_t frame = recCtx.frameIndex;
+    if (worker->used == RECORD_MAX_JOBS) {
+        printf("More than %d secondary command buffers on one worker in a frame\n", RECORD_MAX_JOBS);
+        exit(1);
+    }
+    if (worker->used == worker->allocated[frame]) {
+        VkCommandBufferAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        allocInfo.commandPool = worker->pools[frame];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(vkCtx->device, &allocInfo, &worker->buffers[frame][worker->allocated[frame]]) != VK_SUCCESS) {
+            printf("Failed to allocate secondary command buffer\n");
+            exit(1);
+        }
+        worker->allocated[frame]++;
+    }
+    VkCommandBuffer commandBuffer = worker->buffers[frame][worker->used++];
+    begin_secondary_buffer(encoder, commandBuffer, recCtx.framebuffer, recCtx.extent, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+}
+
+static void run_jobs(RecordWorker* worker) {
+    for (;;) {
+        int index = SDL_AddAtomicInt(&recCtx.nextJob, 1);
+        if (index >= (int)recCtx.jobCount) {
+            return;
+        }
+        RecordJob* job = &recCtx.jobs[index];
+        if (!job->func) {
+            continue;
+        }
+        CommandEncoder encoder;
+        begin_secondary(worker, &encoder);
+        job->func(&encoder, job->userData, job->first, job->count);
+        end_secondary_buffer(&encoder);
+        job->commandBuffer = encoder.commandBuffer;
+    }
+}
+
+static int SDLCALL worker_main(void* data) {
+    RecordWorker* worker = data;
+    for (;;) {
+        SDL_WaitSemaphore(worker->start);
+        if (SDL_GetAtomicInt(&recCtx.quit)) {
+            return 0;
+        }
+        run_jobs(worker);
+        SDL_SignalSemaphore(recCtx.done);
+    }
+}
+
+// The calling thread records too; helpers are only woken when there is a job left for them
+static void dispatch(VkFramebuffer framebuffer, VkExtent2D extent) {
+    recCtx.framebuffer = framebuffer;
+    recCtx.extent = extent;
+    SDL_SetAtomicInt(&recCtx.nextJob, 0);
+    uint32_t helpers = recCtx.activeWorkers - 1;
+    if (helpers > recCtx.jobCount - 1) {
+        helpers = recCtx.jobCount - 1;
+    }
+    for (uint32_t i = 1; i <= helpers; i++) {
+        SDL_SignalSemaphore(recCtx.workers[i].start);
+    }
+    run_jobs(&recCtx.workers[0]);
+    for (uint32_t i = 0; i < helpers; i++) {
+        SDL_WaitSemaphore(recCtx.done);
+    }
+}
+
+void init_record(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    memset(&recCtx, 0, sizeof(recCtx));
+
+    int cores = SDL_GetNumLogicalCPUCores();
+    recCtx.workerCount = cores < 1 ? 1 : (cores > RECORD_MAX_WORKERS ? RECORD_MAX_WORKERS : (uint32_t)cores);
+    recCtx.activeWorkers = recCtx.workerCount;
+    recCtx.done = SDL_CreateSemaphore(0);
+    if (!recCtx.done) {
+        printf("Failed to create record semaphore: %s\n", SDL_GetError());
+        exit(1);
+    }
+
+    VkCommandPoolCreateInfo poolInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    poolInfo.queueFamilyIndex = vkCtx->graphicsFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Re-recorded every frame
+    for (uint32_t w = 0; w < recCtx.workerCount; w++) {
+        RecordWorker* worker = &recCtx.workers[w];
+        for (uint32_t f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+            if (vkCreateCommandPool(vkCtx->device, &poolInfo, vk_allocator(ALLOC_OBJECT_COMMAND_POOL), &worker->pools[f]) != VK_SUCCESS) {
+                printf("Failed to create record command pool\n");
+                exit(1);
+            }
+        }
+        if (w == 0) {
+            continue; // Worker 0 is whoever calls record_execute
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "record%u", w);
+        worker->start = SDL_CreateSemaphore(0);
+        worker->thread = worker->start ? SDL_CreateThread(worker_main, name, worker) : NULL;
+        if (!worker->thread) {
+            printf("Failed to create record worker: %s\n", SDL_GetError());
+            exit(1);
+        }
+    }
+    printf("Command recording: %u threads\n", recCtx.workerCount);
+}
+
+void cleanup_record(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    SDL_SetAtomicInt(&recCtx.quit, 1);
+    for (uint32_t w = 1; w < recCtx.workerCount; w++) {
+        SDL_SignalSemaphore(recCtx.workers[w].start);
+        SDL_WaitThread(recCtx.workers[w].thread, NULL);
+        SDL_DestroySemaphore(recCtx.workers[w].start);
+    }
+    for (uint32_t w = 0; w < recCtx.workerCount; w++) {
+        for (uint32_t f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+            vkDestroyCommandPool(vkCtx->device, recCtx.workers[w].pools[f], vk_allocator(ALLOC_OBJECT_COMMAND_POOL));
+        }
+    }
+    if (recCtx.done) {
+        SDL_DestroySemaphore(recCtx.done);
+    }
+    memset(&recCtx, 0, sizeof(recCtx));
+}
+
+void record_frame_begin(uint32_t frameIndex) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    recCtx.frameIndex = frameIndex;
+    for (uint32_t w = 0; w < recCtx.workerCount; w++) {
+        vkResetCommandPool(vkCtx->device, recCtx.workers[w].pools[frameIndex], 0);
+        recCtx.workers[w].used = 0;
+    }
+    recCtx.lastJobs = 0;
+    recCtx.lastRecordNs = 0;
+}
+
+void record_set_workers(uint32_t count) {
+    recCtx.activeWorkers = SDL_clamp(count, 1u, recCtx.workerCount);
+}
+
+void record_add_job(RecordJobFunc func, void* userData, uint32_t first, uint32_t count) {
+    if (recCtx.jobCount == RECORD_MAX_JOBS) {
+        printf("Record job queue full (%d jobs)\n", RECORD_MAX_JOBS);
+        exit(1);
+    }
+    RecordJob* job = &recCtx.jobs[recCtx.jobCount++];
+    job->func = func;
+    job->userData = userData;
+    job->first = first;
+    job->count = count;
+    job->commandBuffer = VK_NULL_HANDLE;
+}
+
+void record_add_split(RecordJobFunc func, void* userData, uint32_t total) {
+    // About four batches per thread, so one slow thread does not hold up the rest
+    uint32_t perJob = total / (recCtx.activeWorkers * 4);
+    if (perJob < RECORD_MIN_DRAWS_PER_JOB) {
+        perJob = RECORD_MIN_DRAWS_PER_JOB;
+    }
+    uint32_t slots = RECORD_MAX_JOBS - recCtx.jobCount;
+    if (slots > 0 && (total + perJob - 1) / perJob > slots) {
+        perJob = (total + slots - 1) / slots;
+    }
+    for (uint32_t first = 0; first < total; first += perJob) {
+        record_add_job(func, userData, first, total - first < perJob ? total - first : perJob);
+    }
+}
+
+void record_add_secondary(VkCommandBuffer commandBuffer) {
+    record_add_job(NULL, NULL, 0, 0);
+    recCtx.jobs[recCtx.jobCount - 1].commandBuffer = commandBuffer;
+}
+
+void record_execute(CommandEncoder* encoder, VkFramebuffer framebuffer, VkExtent2D extent) {
+    if (recCtx.jobCount == 0) {
+        return;
+    }
+    uint64_t start = SDL_GetTicksNS();
+    dispatch(framebuffer, extent);
+
+    VkCommandBuffer secondaries[RECORD_MAX_JOBS];
+    for (uint32_t i = 0; i < recCtx.jobCount; i++) {
+        secondaries[i] = recCtx.jobs[i].commandBuffer;
+    }
+    vkCmdExecuteCommands(encoder->commandBuffer, recCtx.jobCount, secondaries);
+    encoder_invalidate(encoder); // Bound state is undefined after executing secondaries
+
+    // Summed over every render pass of the frame
+    recCtx.lastJobs += recCtx.jobCount;
+    recCtx.lastRecordNs += (double)(SDL_GetTicksNS() - start);
+    recCtx.jobCount = 0;
+}
+
+void record_benchmark(RecordJobFunc func, void* userData, uint32_t drawCount, RecordBenchmark* result) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    // Pools of the slot about to be recorded are reset underneath its last frame
+    vulkan_wait_frame(vulkan_frame_submitted());
+
+    uint32_t activeWorkers = recCtx.activeWorkers;
+    uint32_t frame = vkCtx->currentFrame;
+    result->drawCount = drawCount;
+    result->threadCount = recCtx.workerCount;
+    for (uint32_t threads = 1; threads <= recCtx.workerCount; threads++) {
+        recCtx.activeWorkers = threads;
+        uint64_t best = UINT64_MAX;
+        for (uint32_t run = 0; run < RECORD_BENCHMARK_RUNS; run++) {
+            record_frame_begin(frame);
+            uint64_t start = SDL_GetTicksNS();
+            record_add_split(func, userData, drawCount);
+            dispatch(VK_NULL_HANDLE, (VkExtent2D){vkCtx->width, vkCtx->height});
+            uint64_t elapsed = SDL_GetTicksNS() - start;
+            recCtx.jobCount = 0;
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+        result->ms[threads - 1] = best / 1000000.0;
+        printf("Record benchmark: %u draws on %u threads: %.3f ms (x%.2f)\n", drawCount, threads,
+               result->ms[threads - 1], result->ms[0] / result->ms[threads - 1]);
+    }
+    record_frame_begin(frame);
+    recCtx.activeWorkers = activeWorkers;
+}
+
+void record_get_stats(RecordStats* stats) {
+    stats->workerCount = recCtx.workerCount;
+    stats->activeWorkers = recCtx.activeWorkers;
+    stats->lastJobs = recCtx.lastJobs;
+    stats->lastRecordMs = recCtx.lastRecordNs / 1000000.0;
+}
+
+//================================================
+// Cached secondaries
+//================================================
+
+void record_cache_init(RecordCache* cache) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    memset(cache, 0, sizeof(*cache));
+
+    VkCommandPoolCreateInfo poolInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    poolInfo.queueFamilyIndex = vkCtx->graphicsFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Versions are reset one at a time
+    if (vkCreateCommandPool(vkCtx->device, &poolInfo, vk_allocator(ALLOC_OBJECT_COMMAND_POOL), &cache->pool) != VK_SUCCESS) {
+        printf("Failed to create cache command pool\n");
+        exit(1);
+    }
+    VkCommandBufferAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocInfo.commandPool = cache->pool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = RECORD_CACHE_VERSIONS;
+    if (vkAllocateCommandBuffers(vkCtx->device, &allocInfo, cache->buffers) != VK_SUCCESS) {
+        printf("Failed to allocate cached command buffers\n");
+        exit(1);
+    }
+}
+
+void record_cache_destroy(RecordCache* cache) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (cache->pool == VK_NULL_HANDLE) {
+        return;
+    }
+    for (uint32_t i = 0; i < RECORD_CACHE_VERSIONS; i++) {
+        vulkan_wait_frame(cache->lastUsedFrame[i]);
+    }
+    vkDestroyCommandPool(vkCtx->device, cache->pool, vk_allocator(ALLOC_OBJECT_COMMAND_POOL));
+    memset(cache, 0, sizeof(*cache));
+}
+
+VkCommandBuffer record_cache_get(RecordCache* cache, VkExtent2D extent, const void* key, size_t keySize, RecordJobFunc func, void* userData, uint32_t count) {
+    if (keySize > RECORD_CACHE_KEY_SIZE) {
+        printf("Record cache key of %zu bytes exceeds RECORD_CACHE_KEY_SIZE\n", keySize);
+        exit(1);
+    }
+
+    if (!cache->valid || cache->keySize != keySize || memcmp(cache->key, key, keySize) != 0) {
+        // Record into the oldest version; with one more version than frames in flight, its last
+        // frame has normally completed already
+        uint32_t next = (cache->current + 1) % RECORD_CACHE_VERSIONS;
+        vulkan_wait_frame(cache->lastUsedFrame[next]);
+        uint64_t start = SDL_GetTicksNS();
+        VkCommandBuffer commandBuffer = cache->buffers[next];
+        vkResetCommandBuffer(commandBuffer, 0);
+        // Replayed by consecutive frames while earlier ones are still pending
+        CommandEncoder encoder;
+        begin_secondary_buffer(&encoder, commandBuffer, VK_NULL_HANDLE, extent, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+        func(&encoder, userData, 0, count);
+        end_secondary_buffer(&encoder);
+
+        memcpy(cache->key, key, keySize);
+        cache->keySize = keySize;
+        cache->current = next;
+        cache->valid = VK_TRUE;
+        cache->recordCount++;
+        cache->lastRecordMs = (SDL_GetTicksNS() - start) / 1000000.0;
+    }
+    cache->lastUsedFrame[cache->current] = vulkan_frame_submitted() + 1; // The frame being recorded
+    return cache->buffers[cache->current];
+}
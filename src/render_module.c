@@ -0,0 +1,522 @@
+#include "render_module.h"
+#include "triangle_module.h"
+#include "defer_module.h"
+#include "arena_module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAILBOX_FRESH 0x4 // Set in `middle` when the writer has published since the last read
+
+// Single-producer single-consumer triple buffer. The writer fills `back`, the reader uses
+// `front`, and each side trades its slot for `middle` with one atomic exchange: the writer
+// never waits for the reader, and the reader always gets the newest complete slot.
+typedef struct {
+    SDL_AtomicInt middle;
+    int back;  // Writer owned
+    int front; // Reader owned
+} Mailbox;
+
+typedef struct {
+    SDL_Thread* thread;
+    SDL_Window* window;
+    SDL_Semaphore* snapshotSignal; // Posted once per publish, wakes the render thread
+    SDL_AtomicInt quit;
+    SDL_AtomicInt requested; // A ready event is queued and the main thread has not answered it
+    Uint32 readyEvent;
+
+    Mailbox snapshotBox; // Main thread -> render thread
+    FrameSnapshot snapshots[RENDER_MAILBOX_SLOTS];
+    Mailbox statsBox; // Render thread -> main thread
+    RenderStats stats[RENDER_MAILBOX_SLOTS];
+
+    // Render thread only: what has been applied from the snapshots so far
+    uint32_t resizeSerial;
+    uint32_t defragSerial;
+    uint32_t benchmarkSerial;
+    RecordBenchmark benchmark;
+    RecordCache staticCache;
+    TriangleGrid grid;          // Sized to the scene pass's render area
+    QuadInstance* quadInstances; // Instancing stress test layout, rebuilt when the count changes
+    uint32_t quadInstanceCount;
+    VkBool32 cullInstancesDirty; // Rebuilt since the cull pass last got a copy
+    FrameAllocation quadInstanceData; // This frame's copy in the upload ring
+    MeshHandle churnMeshes[RENDER_CHURN_MESHES]; // Geometry churn load, replaced round robin
+    uint32_t churnNext;
+    uint32_t churnSeed;
+    GraphResource backbuffer;   // This frame's graph resources, for the pass callbacks
+    GraphResource sceneTarget;  // The backbuffer, or an offscreen image below full size
+    VkBool32 swapchainDirty;
+    uint64_t recordNs;
+    uint64_t stallNs;
+    uint64_t staleFrames;
+} RenderContext;
+
+static RenderContext renderCtx = {0};
+
+// Everything the cached static secondary was recorded from; any change re-records it
+typedef struct {
+    VkPipeline pipeline;
+    uint32_t geometryGeneration;
+    uint32_t width;
+    uint32_t height;
+    uint32_t gridDraws;
+    VkBool32 showTriangle;
+    VkBool32 showQuad;
+} StaticSceneKey;
+
+static void mailbox_init(Mailbox* mailbox) {
+    mailbox->back = 0;
+    SDL_SetAtomicInt(&mailbox->middle, 1);
+    mailbox->front = 2;
+}
+
+static void mailbox_publish(Mailbox* mailbox) {
+    mailbox->back = SDL_SetAtomicInt(&mailbox->middle, mailbox->back | MAILBOX_FRESH) & ~MAILBOX_FRESH;
+}
+
+// Returns VK_TRUE and moves `front` to the newest slot if anything was published since the last read
+static VkBool32 mailbox_read(Mailbox* mailbox) {
+    if (!(SDL_GetAtomicInt(&mailbox->middle) & MAILBOX_FRESH)) {
+        return VK_FALSE;
+    }
+    mailbox->front = SDL_SetAtomicInt(&mailbox->middle, mailbox->front) & ~MAILBOX_FRESH;
+    return VK_TRUE;
+}
+
+//================================================
+// Render thread
+//================================================
+
+static void publish_stats(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    RenderStats* stats = &renderCtx.stats[renderCtx.statsBox.back];
+    stats->submittedFrame = vulkan_frame_submitted();
+    stats->completedFrame = vulkan_frame_completed();
+    stats->timelineSupported = vkCtx->timelineSupported;
+    stats->presentMode = vkCtx->presentMode;
+    stats->bufferedImages = vkCtx->bufferedImages;
+    stats->imageCount = vkCtx->imageCount;
+    stats->width = vkCtx->width;
+    stats->height = vkCtx->height;
+    stats->presentModeCount = vkCtx->presentModeCount;
+    memcpy(stats->presentModes, vkCtx->presentModes, sizeof(stats->presentModes));
+    memcpy(stats->presentLatency, vkCtx->presentLatency, sizeof(stats->presentLatency));
+    pacer_get_stats(&stats->pacer);
+    memory_get_stats(&stats->memory);
+    geometry_get_stats(&stats->geometry);
+    stats->deferPending = vk_defer_pending();
+    stats->animating = stats->geometry.defragActive || stats->deferPending > 0;
+    record_get_stats(&stats->record);
+    stats->staticRecords = renderCtx.staticCache.recordCount;
+    stats->staticRecordMs = renderCtx.staticCache.lastRecordMs;
+    stats->benchmark = renderCtx.benchmark;
+    arena_get_thread_stats(&stats->arena);
+    graph_get_stats(&stats->graph);
+    encoder_get_stats(&stats->encoder);
+    cull_get_stats(&stats->cull);
+    stats->scaledRenderSupported = vkCtx->scaledRenderSupported;
+    stats->recordMs = renderCtx.recordNs / 1000000.0;
+    stats->stallMs = renderCtx.stallNs / 1000000.0;
+    stats->staleFrames = renderCtx.staleFrames;
+    stats->imguiTextureSerial = imgui_textures_applied();
+    mailbox_publish(&renderCtx.statsBox);
+}
+
+// One ready event in the SDL queue at a time, however far behind the main thread is
+static void request_snapshot(void) {
+    if (!SDL_CompareAndSwapAtomicInt(&renderCtx.requested, 0, 1)) {
+        return;
+    }
+    SDL_Event event = {0};
+    event.type = renderCtx.readyEvent;
+    if (!SDL_PushEvent(&event)) {
+        SDL_SetAtomicInt(&renderCtx.requested, 0);
+    }
+}
+
+// Stale posts (a snapshot already picked up by an earlier read) just loop back to the mailbox
+static VkBool32 wait_for_snapshot(Sint32 timeoutMs) {
+    while (!mailbox_read(&renderCtx.snapshotBox)) {
+        if (SDL_GetAtomicInt(&renderCtx.quit) || !SDL_WaitSemaphoreTimeout(renderCtx.snapshotSignal, timeoutMs)) {
+            return VK_FALSE;
+        }
+    }
+    return VK_TRUE;
+}
+
+// UI commands arrive as state; apply whatever changed since the last snapshot we rendered
+static void apply_snapshot(const FrameSnapshot* snapshot) {
+    if (vulkan_set_present_mode(snapshot->presentMode)) {
+        renderCtx.swapchainDirty = VK_TRUE;
+    }
+    if (vulkan_set_buffered_images(snapshot->bufferedImages)) {
+        renderCtx.swapchainDirty = VK_TRUE;
+    }
+    if (snapshot->resizeSerial != renderCtx.resizeSerial) {
+        renderCtx.resizeSerial = snapshot->resizeSerial; // Any number of resizes, one recreation
+        renderCtx.swapchainDirty = VK_TRUE;
+    }
+    if (snapshot->defragSerial != renderCtx.defragSerial) {
+        renderCtx.defragSerial = snapshot->defragSerial;
+        geometry_defrag_begin();
+    }
+    pacer_set_enabled(snapshot->lowLatency);
+    record_set_workers(snapshot->recordWorkers);
+    if (snapshot->benchmarkSerial != renderCtx.benchmarkSerial) {
+        renderCtx.benchmarkSerial = snapshot->benchmarkSerial;
+        VulkanContext* vkCtx = get_vulkan_context();
+        TriangleGrid grid = {snapshot->gridDraws > 0 ? snapshot->gridDraws : RENDER_BENCHMARK_DRAWS, {vkCtx->width, vkCtx->height}};
+        record_benchmark(render_triangle_grid, &grid, grid.count, &renderCtx.benchmark);
+    }
+}
+
+// Adapters so the fixed meshes and ImGui can be queued as record jobs
+static void record_triangle(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count) {
+    render_triangle(encoder);
+}
+
+static void record_quad(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count) {
+    render_quad(encoder);
+}
+
+static void record_static_scene(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count) {
+    FrameSnapshot* snapshot = userData;
+    if (snapshot->showTriangle) {
+        render_triangle(encoder);
+    }
+    if (snapshot->showQuad) {
+        render_quad(encoder);
+    }
+    if (snapshot->gridDraws > 0) {
+        render_triangle_grid(encoder, &renderCtx.grid, 0, renderCtx.grid.count);
+    }
+}
+
+static void record_quad_instances(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count) {
+    const FrameAllocation* data = userData;
+    render_quad_instance_buffer(encoder, data->buffer, data->offset, count);
+}
+
+static void record_culled_quads(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count) {
+    cull_draw(encoder);
+}
+
+static void record_imgui(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count) {
+    render_imgui(encoder, userData);
+}
+
+// Graph passes. The scene and the UI declare the same contents, so at full scale they share one
+// render pass instance; secondaries are recorded by whichever pass executes them.
+static void prepare_quad_instances(uint32_t count) {
+    if (count == renderCtx.quadInstanceCount) {
+        return;
+    }
+    if (count > renderCtx.quadInstanceCount) {
+        renderCtx.quadInstances = heap_realloc(renderCtx.quadInstances, count * sizeof(QuadInstance));
+        if (!renderCtx.quadInstances) {
+            printf("Failed to allocate %u quad instances\n", count);
+            exit(1);
+        }
+    }
+    fill_quad_instance_grid(renderCtx.quadInstances, count);
+    renderCtx.quadInstanceCount = count;
+    renderCtx.cullInstancesDirty = VK_TRUE;
+}
+
+// Pool stress test: meshes of random size come and go, so the pools fragment, grow by blocks,
+// and shrink back once the load stops and the freed blocks drain
+static void churn_meshes(uint32_t count) {
+    if (count == 0) {
+        for (uint32_t i = 0; i < RENDER_CHURN_MESHES; i++) {
+            if (renderCtx.churnMeshes[i].vertexCount > 0) {
+                geometry_destroy_mesh(&renderCtx.churnMeshes[i]);
+            }
+        }
+        return;
+    }
+
+    // Contents are never drawn; geometry_create_mesh copies them out, so this frame's arena is enough
+    float* vertices = frame_alloc(RENDER_CHURN_MAX_VERTICES * GEOMETRY_VERTEX_STRIDE);
+    uint32_t* indices = frame_alloc(RENDER_CHURN_MAX_VERTICES * sizeof(uint32_t));
+    memset(vertices, 0, RENDER_CHURN_MAX_VERTICES * GEOMETRY_VERTEX_STRIDE);
+    for (uint32_t i = 0; i < RENDER_CHURN_MAX_VERTICES; i++) {
+        indices[i] = i;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        MeshHandle* mesh = &renderCtx.churnMeshes[renderCtx.churnNext];
+        renderCtx.churnNext = (renderCtx.churnNext + 1) % RENDER_CHURN_MESHES;
+        if (mesh->vertexCount > 0) {
+            geometry_destroy_mesh(mesh);
+        }
+        // Mostly small meshes, one in 32 as large as it gets
+        renderCtx.churnSeed = renderCtx.churnSeed * 1664525u + 1013904223u;
+        uint32_t vertexCount = (renderCtx.churnSeed >> 27) == 0 ? RENDER_CHURN_MAX_VERTICES : 3 + (renderCtx.churnSeed >> 8) % 4096;
+        geometry_create_mesh(vertices, vertexCount, indices, vertexCount, mesh);
+    }
+    upload_flush();
+}
+
+static void pass_scene(CommandEncoder* encoder, const GraphPassContext* context, void* userData) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    FrameSnapshot* snapshot = userData;
+    renderCtx.grid.count = snapshot->gridDraws;
+    renderCtx.grid.extent = context->extent;
+    if (context->contents == VK_SUBPASS_CONTENTS_INLINE) {
+        record_static_scene(encoder, snapshot, 0, 1);
+        if (snapshot->gpuCulling) {
+            cull_draw(encoder);
+        } else {
+            render_quad_instances(encoder, renderCtx.quadInstances, renderCtx.quadInstanceCount);
+        }
+        return;
+    }
+
+    if (snapshot->cacheStatic) {
+        // After begin_frame, so a defrag step that moved meshes this frame is part of the key
+        StaticSceneKey key;
+        memset(&key, 0, sizeof(key));
+        key.pipeline = vkCtx->graphicsPipeline;
+        key.geometryGeneration = geometry_generation();
+        key.width = context->extent.width;
+        key.height = context->extent.height;
+        key.gridDraws = snapshot->gridDraws;
+        key.showTriangle = snapshot->showTriangle;
+        key.showQuad = snapshot->showQuad;
+        record_add_secondary(record_cache_get(&renderCtx.staticCache, context->extent, &key, sizeof(key), record_static_scene, snapshot, 1));
+    } else {
+        if (snapshot->showTriangle) {
+            record_add_job(record_triangle, NULL, 0, 1);
+        }
+        if (snapshot->showQuad) {
+            record_add_job(record_quad, NULL, 0, 1);
+        }
+        if (snapshot->gridDraws > 0) {
+            record_add_split(render_triangle_grid, &renderCtx.grid, renderCtx.grid.count);
+        }
+    }
+    // Instance data lives in this frame's upload ring, so it is never part of the cached secondary.
+    // The ring is not thread safe: copy here, the worker only records the draw.
+    if (snapshot->gpuCulling) {
+        if (renderCtx.quadInstanceCount > 0) {
+            record_add_job(record_culled_quads, NULL, 0, 1);
+        }
+    } else if (renderCtx.quadInstanceCount > 0 &&
+        upload_quad_instances(renderCtx.quadInstances, renderCtx.quadInstanceCount, &renderCtx.quadInstanceData)) {
+        record_add_job(record_quad_instances, &renderCtx.quadInstanceData, 0, renderCtx.quadInstanceCount);
+    }
+    record_execute(encoder, context->framebuffer, context->extent);
+}
+
+static void pass_upscale(CommandEncoder* encoder, const GraphPassContext* context, void* userData) {
+    VkExtent2D src = graph_extent(renderCtx.sceneTarget);
+    VkExtent2D dst = graph_extent(renderCtx.backbuffer);
+    VkImageBlit region = {0};
+    region.srcSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.srcOffsets[1] = (VkOffset3D){(int32_t)src.width, (int32_t)src.height, 1};
+    region.dstSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.dstOffsets[1] = (VkOffset3D){(int32_t)dst.width, (int32_t)dst.height, 1};
+    vkCmdBlitImage(encoder->commandBuffer, graph_image(renderCtx.sceneTarget), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   graph_image(renderCtx.backbuffer), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+}
+
+static void pass_ui(CommandEncoder* encoder, const GraphPassContext* context, void* userData) {
+    FrameSnapshot* snapshot = userData;
+    if (context->contents == VK_SUBPASS_CONTENTS_INLINE) {
+        render_imgui(encoder, &snapshot->imgui.drawData);
+        return;
+    }
+    record_add_job(record_imgui, &snapshot->imgui.drawData, 0, 1);
+    record_execute(encoder, context->framebuffer, context->extent);
+}
+
+static void render_frame(FrameSnapshot* snapshot) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    arena_frame_begin(); // This thread's arenas, the main thread resets its own
+    if (renderCtx.swapchainDirty) {
+        recreate_swapchain(renderCtx.window);
+        renderCtx.swapchainDirty = VK_FALSE;
+    }
+    vkCtx->frameStartNs = snapshot->inputNs;
+
+    // Acquire next image (waits for this frame slot's fence)
+    uint64_t stallStart = SDL_GetTicksNS();
+    uint32_t imageIndex;
+    VkResult result = vulkan_acquire_frame(&imageIndex);
+    renderCtx.stallNs = SDL_GetTicksNS() - stallStart;
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        renderCtx.swapchainDirty = VK_TRUE;
+        return;
+    }
+
+    // Record command buffer: the scene, an upscale when it rendered below window size, then ImGui on top
+    uint64_t recordStart = SDL_GetTicksNS();
+    imgui_apply_textures(&snapshot->imgui);
+    prepare_quad_instances(snapshot->quadInstances);
+    churn_meshes(snapshot->meshChurn);
+    if (snapshot->gpuCulling) {
+        // A new instance set goes out on the upload queue, and begin_frame acquires it. Rebuilds
+        // while culling was off are picked up here too.
+        if (renderCtx.cullInstancesDirty) {
+            cull_set_instances(renderCtx.quadInstances, renderCtx.quadInstanceCount);
+            upload_flush();
+            renderCtx.cullInstancesDirty = VK_FALSE;
+        }
+    }
+    CommandEncoder* encoder = vulkan_begin_frame();
+    if (snapshot->gpuCulling) {
+        float bounds[4] = {-snapshot->cullRegion, -snapshot->cullRegion, snapshot->cullRegion, snapshot->cullRegion};
+        cull_dispatch(encoder->commandBuffer, bounds);
+    }
+    graph_begin();
+    renderCtx.backbuffer = graph_import_swapchain(imageIndex);
+    renderCtx.sceneTarget = renderCtx.backbuffer;
+    if (snapshot->renderScale < 1.0f && vkCtx->scaledRenderSupported) {
+        VkExtent2D extent = {(uint32_t)(vkCtx->width * snapshot->renderScale), (uint32_t)(vkCtx->height * snapshot->renderScale)};
+        extent.width = extent.width > 0 ? extent.width : 1;
+        extent.height = extent.height > 0 ? extent.height : 1;
+        renderCtx.sceneTarget = graph_create_image("scene", vkCtx->surfaceFormat.format, extent);
+    }
+
+    // Secondaries for everything once anything is cached or recorded on the pool
+    VkSubpassContents contents = snapshot->parallelRecording || snapshot->cacheStatic ?
+                                 VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+    VkClearColorValue clearColor = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    uint32_t scene = graph_add_pass("scene", pass_scene, snapshot, contents);
+    graph_write_clear(scene, renderCtx.sceneTarget, clearColor);
+    if (renderCtx.sceneTarget != renderCtx.backbuffer) {
+        uint32_t upscale = graph_add_pass("upscale", pass_upscale, NULL, VK_SUBPASS_CONTENTS_INLINE);
+        graph_read(upscale, renderCtx.sceneTarget, GRAPH_USAGE_TRANSFER_SRC);
+        graph_write(upscale, renderCtx.backbuffer, GRAPH_USAGE_TRANSFER_DST);
+    }
+    uint32_t ui = graph_add_pass("ui", pass_ui, snapshot, contents);
+    graph_write(ui, renderCtx.backbuffer, GRAPH_USAGE_COLOR_ATTACHMENT);
+    graph_execute(encoder);
+    renderCtx.recordNs = SDL_GetTicksNS() - recordStart;
+
+    stallStart = SDL_GetTicksNS();
+    VkResult presentResult = vulkan_end_frame(imageIndex);
+    renderCtx.stallNs += SDL_GetTicksNS() - stallStart;
+    pacer_frame_submitted();
+    if (result == VK_SUBOPTIMAL_KHR || presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR) {
+        renderCtx.swapchainDirty = VK_TRUE;
+    }
+}
+
+static int SDLCALL render_thread_main(void* data) {
+    SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+    VkBool32 hasSnapshot = VK_FALSE;
+
+    while (!SDL_GetAtomicInt(&renderCtx.quit)) {
+        pacer_wait(); // The main thread samples input as soon as it sees the request
+        request_snapshot();
+
+        // Give the UI about one refresh. If it misses that (long UI frame, modal resize loop),
+        // present the previous snapshot again so the display keeps its cadence. With nothing
+        // visible, or on demand, park until the main thread publishes.
+        const FrameSnapshot* last = &renderCtx.snapshots[renderCtx.snapshotBox.front];
+        VkBool32 showing = hasSnapshot && last->visible && !last->onDemand;
+        PacerStats pacerStats;
+        pacer_get_stats(&pacerStats);
+        Sint32 timeoutMs = showing ? (Sint32)pacerStats.refreshMs + 1 : -1;
+        VkBool32 fresh = wait_for_snapshot(timeoutMs);
+        if (SDL_GetAtomicInt(&renderCtx.quit)) {
+            break;
+        }
+        hasSnapshot |= fresh;
+
+        FrameSnapshot* snapshot = &renderCtx.snapshots[renderCtx.snapshotBox.front];
+        if (!hasSnapshot || !snapshot->visible) {
+            continue;
+        }
+        if (fresh) {
+            apply_snapshot(snapshot);
+        } else {
+            renderCtx.staleFrames++;
+        }
+        render_frame(snapshot);
+        publish_stats();
+    }
+    return 0;
+}
+
+//================================================
+// Main thread
+//================================================
+
+void render_thread_start(SDL_Window* window) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    renderCtx.window = window;
+    renderCtx.resizeSerial = 0;
+    renderCtx.defragSerial = 0;
+    renderCtx.benchmarkSerial = 0;
+    memset(&renderCtx.benchmark, 0, sizeof(renderCtx.benchmark));
+    renderCtx.swapchainDirty = VK_FALSE;
+    renderCtx.stallNs = 0;
+    renderCtx.staleFrames = 0;
+    SDL_SetAtomicInt(&renderCtx.quit, 0);
+    SDL_SetAtomicInt(&renderCtx.requested, 0);
+    mailbox_init(&renderCtx.snapshotBox);
+    mailbox_init(&renderCtx.statsBox);
+
+    renderCtx.readyEvent = SDL_RegisterEvents(1);
+    renderCtx.snapshotSignal = SDL_CreateSemaphore(0);
+    if (renderCtx.readyEvent == 0 || !renderCtx.snapshotSignal) {
+        printf("Failed to set up render thread signalling: %s\n", SDL_GetError());
+        exit(1);
+    }
+
+    record_cache_init(&renderCtx.staticCache);
+
+    // Stats for the first UI frame, still on this thread
+    publish_stats();
+
+    renderCtx.thread = SDL_CreateThread(render_thread_main, "render", NULL);
+    if (!renderCtx.thread) {
+        printf("Failed to create render thread: %s\n", SDL_GetError());
+        exit(1);
+    }
+    printf("Render thread started (%ux%u, %u images)\n", vkCtx->width, vkCtx->height, vkCtx->imageCount);
+}
+
+void render_thread_stop(void) {
+    if (!renderCtx.thread) {
+        return;
+    }
+    SDL_SetAtomicInt(&renderCtx.quit, 1);
+    SDL_SignalSemaphore(renderCtx.snapshotSignal);
+    SDL_WaitThread(renderCtx.thread, NULL);
+    renderCtx.thread = NULL;
+
+    record_cache_destroy(&renderCtx.staticCache);
+    heap_free(renderCtx.quadInstances);
+    renderCtx.quadInstances = NULL;
+    renderCtx.quadInstanceCount = 0;
+    renderCtx.cullInstancesDirty = VK_FALSE;
+    churn_meshes(0);
+    SDL_DestroySemaphore(renderCtx.snapshotSignal);
+    renderCtx.snapshotSignal = NULL;
+    for (uint32_t i = 0; i < RENDER_MAILBOX_SLOTS; i++) {
+        imgui_snapshot_release(&renderCtx.snapshots[i].imgui);
+    }
+}
+
+Uint32 render_ready_event(void) {
+    return renderCtx.readyEvent;
+}
+
+FrameSnapshot* render_snapshot_begin(void) {
+    return &renderCtx.snapshots[renderCtx.snapshotBox.back];
+}
+
+void render_snapshot_publish(void) {
+    SDL_SetAtomicInt(&renderCtx.requested, 0); // Answered, the next request may be queued
+    mailbox_publish(&renderCtx.snapshotBox);
+    SDL_SignalSemaphore(renderCtx.snapshotSignal);
+}
+
+void render_get_stats(RenderStats* stats) {
+    mailbox_read(&renderCtx.statsBox);
+    *stats = renderCtx.stats[renderCtx.statsBox.front];
+}
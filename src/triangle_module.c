@@ -1,59 +1,32 @@
 #include "triangle_module.h"
+#include "geometry_module.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <vulkan/vulkan.h>
 
-void create_triangle(void) {
-    VulkanContext* vkCtx = get_vulkan_context();
+static MeshHandle triangleMesh;
+static MeshHandle quadMesh;
+static MeshHandle unitQuadMesh; // Centered and white, placed and tinted per instance
 
+void create_triangle(void) {
     float vertices[] = {
         0.0f, -0.5f, 0.0f,  1.0f, 0.0f, 0.0f, // Top, red
        -0.5f,  0.5f, 0.0f,  0.0f, 1.0f, 0.0f, // Bottom-left, green
         0.5f,  0.5f, 0.0f,  0.0f, 0.0f, 1.0f  // Bottom-right, blue
     };
 
-    VkBufferCreateInfo bufferInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
-    bufferInfo.size = sizeof(vertices);
-    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    if (vkCreateBuffer(vkCtx->device, &bufferInfo, NULL, &vkCtx->vertexBuffer) != VK_SUCCESS) {
-        printf("Failed to create vertex buffer\n");
-        exit(1);
-    }
-
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(vkCtx->device, vkCtx->vertexBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = find_memory_type(vkCtx, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    if (vkAllocateMemory(vkCtx->device, &allocInfo, NULL, &vkCtx->vertexMemory) != VK_SUCCESS) {
-        printf("Failed to allocate vertex buffer memory\n");
-        exit(1);
-    }
-
-    vkBindBufferMemory(vkCtx->device, vkCtx->vertexBuffer, vkCtx->vertexMemory, 0);
-
-    void* data;
-    vkMapMemory(vkCtx->device, vkCtx->vertexMemory, 0, bufferInfo.size, 0, &data);
-    memcpy(data, vertices, sizeof(vertices));
-    vkUnmapMemory(vkCtx->device, vkCtx->vertexMemory);
+    // Device-local copy is queued; upload_flush submits it
+    geometry_create_mesh(vertices, 3, NULL, 0, &triangleMesh);
 }
 
-void render_triangle(VkCommandBuffer commandBuffer) {
+void render_triangle(CommandEncoder* encoder) {
     VulkanContext* vkCtx = get_vulkan_context();
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkCtx->graphicsPipeline);
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vkCtx->vertexBuffer, offsets);
-    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    encoder_bind_pipeline(encoder, vkCtx->graphicsPipeline);
+    geometry_draw(encoder, &triangleMesh);
 }
 
 void create_quad(void) {
-    VulkanContext* vkCtx = get_vulkan_context();
-
     // Quad vertices in top-left quadrant
     float vertices[] = {
         -0.75f, -0.75f, 0.0f,  1.0f, 1.0f, 0.0f, // Bottom-left, yellow
@@ -63,85 +36,109 @@ void create_quad(void) {
     };
 
     // Indices for two triangles (0,1,2) and (1,2,3)
-    uint16_t indices[] = {0, 1, 2, 1, 2, 3};
+    uint32_t indices[] = {0, 1, 2, 1, 2, 3};
 
-    // Create vertex buffer
-    VkBufferCreateInfo vertexBufferInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
-    vertexBufferInfo.size = sizeof(vertices);
-    vertexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    vertexBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    geometry_create_mesh(vertices, 4, indices, 6, &quadMesh);
 
-    if (vkCreateBuffer(vkCtx->device, &vertexBufferInfo, NULL, &vkCtx->quadBuffer) != VK_SUCCESS) {
-        printf("Failed to create quad vertex buffer\n");
-        exit(1);
-    }
+    float unitVertices[] = {
+        -0.5f, -0.5f, 0.0f,  1.0f, 1.0f, 1.0f,
+         0.5f, -0.5f, 0.0f,  1.0f, 1.0f, 1.0f,
+        -0.5f,  0.5f, 0.0f,  1.0f, 1.0f, 1.0f,
+         0.5f,  0.5f, 0.0f,  1.0f, 1.0f, 1.0f
+    };
+    geometry_create_mesh(unitVertices, 4, indices, 6, &unitQuadMesh);
 
-    VkMemoryRequirements vertexMemRequirements;
-    vkGetBufferMemoryRequirements(vkCtx->device, vkCtx->quadBuffer, &vertexMemRequirements);
+    // printf("Quad vertex and index buffers created successfully\n");
+}
 
-    VkMemoryAllocateInfo vertexAllocInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-    vertexAllocInfo.allocationSize = vertexMemRequirements.size;
-    vertexAllocInfo.memoryTypeIndex = find_memory_type(vkCtx, vertexMemRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+void render_quad(CommandEncoder* encoder) {
+    VulkanContext* vkCtx = get_vulkan_context();
 
-    if (vkAllocateMemory(vkCtx->device, &vertexAllocInfo, NULL, &vkCtx->quadMemory) != VK_SUCCESS) {
-        printf("Failed to allocate quad vertex buffer memory\n");
+    if (quadMesh.indexCount == 0) {
+        printf("Quad mesh was not created!\n");
         exit(1);
     }
 
-    vkBindBufferMemory(vkCtx->device, vkCtx->quadBuffer, vkCtx->quadMemory, 0);
-
-    void* vertexData;
-    vkMapMemory(vkCtx->device, vkCtx->quadMemory, 0, vertexBufferInfo.size, 0, &vertexData);
-    memcpy(vertexData, vertices, sizeof(vertices));
-    vkUnmapMemory(vkCtx->device, vkCtx->quadMemory);
+    encoder_bind_pipeline(encoder, vkCtx->graphicsPipeline);
+    geometry_draw(encoder, &quadMesh); // 6 indices for two triangles
 
-    // Create index buffer
-    VkBufferCreateInfo indexBufferInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
-    indexBufferInfo.size = sizeof(indices);
-    indexBufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-    indexBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // printf("Quad draw command issued\n");
+}
 
-    if (vkCreateBuffer(vkCtx->device, &indexBufferInfo, NULL, &vkCtx->quadIndexBuffer) != VK_SUCCESS) {
-        printf("Failed to create quad index buffer\n");
-        exit(1);
+VkBool32 upload_quad_instances(const QuadInstance* instances, uint32_t count, FrameAllocation* allocation) {
+    VkDeviceSize size = (VkDeviceSize)count * sizeof(QuadInstance);
+    if (!upload_frame_alloc(size, sizeof(float), allocation)) {
+        return VK_FALSE;
     }
+    memcpy(allocation->data, instances, size);
+    return VK_TRUE;
+}
 
-    VkMemoryRequirements indexMemRequirements;
-    vkGetBufferMemoryRequirements(vkCtx->device, vkCtx->quadIndexBuffer, &indexMemRequirements);
-
-    VkMemoryAllocateInfo indexAllocInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-    indexAllocInfo.allocationSize = indexMemRequirements.size;
-    indexAllocInfo.memoryTypeIndex = find_memory_type(vkCtx, indexMemRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    if (vkAllocateMemory(vkCtx->device, &indexAllocInfo, NULL, &vkCtx->quadIndexMemory) != VK_SUCCESS) {
-        printf("Failed to allocate quad index buffer memory\n");
-        exit(1);
+void render_quad_instance_buffer(CommandEncoder* encoder, VkBuffer buffer, VkDeviceSize offset, uint32_t count) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (count == 0) {
+        return;
     }
+    encoder_bind_pipeline(encoder, vkCtx->instancedPipeline);
+    encoder_bind_vertex_buffer(encoder, 1, buffer, offset);
+    geometry_draw_instanced(encoder, &unitQuadMesh, count, 0);
+}
 
-    vkBindBufferMemory(vkCtx->device, vkCtx->quadIndexBuffer, vkCtx->quadIndexMemory, 0);
+void render_quad_instances(CommandEncoder* encoder, const QuadInstance* instances, uint32_t count) {
+    FrameAllocation allocation;
+    if (count > 0 && upload_quad_instances(instances, count, &allocation)) {
+        render_quad_instance_buffer(encoder, allocation.buffer, allocation.offset, count);
+    }
+}
 
-    void* indexData;
-    vkMapMemory(vkCtx->device, vkCtx->quadIndexMemory, 0, indexBufferInfo.size, 0, &indexData);
-    memcpy(indexData, indices, sizeof(indices));
-    vkUnmapMemory(vkCtx->device, vkCtx->quadIndexMemory);
+const MeshHandle* quad_instance_mesh(void) {
+    return &unitQuadMesh;
+}
 
-    // printf("Quad vertex and index buffers created successfully\n");
+void fill_quad_instance_grid(QuadInstance* instances, uint32_t count) {
+    uint32_t columns = 1;
+    while (columns * columns < count) {
+        columns++;
+    }
+    uint32_t rows = (count + columns - 1) / columns;
+    float cellWidth = 2.0f / (float)columns;
+    float cellHeight = 2.0f / (float)rows;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t column = i % columns;
+        uint32_t row = i / columns;
+        QuadInstance* instance = &instances[i];
+        instance->offset[0] = -1.0f + ((float)column + 0.5f) * cellWidth;
+        instance->offset[1] = -1.0f + ((float)row + 0.5f) * cellHeight;
+        instance->scale[0] = cellWidth * 0.7f;
+        instance->scale[1] = cellHeight * 0.7f;
+        instance->color[0] = (uint8_t)(255 * column / columns);
+        instance->color[1] = (uint8_t)(255 * row / rows);
+        instance->color[2] = (uint8_t)(255 - 255 * column / columns);
+        instance->color[3] = 255;
+        instance->rotation = (float)(i % 64) * (3.14159265f / 64.0f);
+    }
 }
 
-void render_quad(VkCommandBuffer commandBuffer) {
+// One triangle per tile of a grid over the render area. Each draw sets its own viewport and scissor,
+// so recording cost grows with the draw count while the GPU still shades about one screen.
+void render_triangle_grid(CommandEncoder* encoder, void* userData, uint32_t first, uint32_t count) {
     VulkanContext* vkCtx = get_vulkan_context();
-
-    if (vkCtx->quadBuffer == VK_NULL_HANDLE || vkCtx->quadIndexBuffer == VK_NULL_HANDLE) {
-        printf("Quad vertex or index buffer is null!\n");
-        exit(1);
+    const TriangleGrid* grid = userData;
+    uint32_t total = grid->count;
+    uint32_t columns = 1;
+    while (columns * columns < total) {
+        columns++;
+    }
+    uint32_t rows = (total + columns - 1) / columns;
+    float tileWidth = (float)grid->extent.width / (float)columns;
+    float tileHeight = (float)grid->extent.height / (float)rows;
+
+    encoder_bind_pipeline(encoder, vkCtx->graphicsPipeline);
+    for (uint32_t i = first; i < first + count; i++) {
+        VkViewport viewport = {(float)(i % columns) * tileWidth, (float)(i / columns) * tileHeight, tileWidth, tileHeight, 0.0f, 1.0f};
+        VkRect2D scissor = {{(int32_t)viewport.x, (int32_t)viewport.y}, {(uint32_t)tileWidth + 1, (uint32_t)tileHeight + 1}};
+        encoder_set_viewport(encoder, &viewport);
+        encoder_set_scissor(encoder, &scissor);
+        geometry_draw(encoder, &triangleMesh);
     }
-
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkCtx->graphicsPipeline);
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vkCtx->quadBuffer, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, vkCtx->quadIndexBuffer, 0, VK_INDEX_TYPE_UINT16);
-    vkCmdDrawIndexed(commandBuffer, 6, 1, 0, 0, 0); // 6 indices for two triangles
-
-    // printf("Quad draw command issued\n");
 }
-
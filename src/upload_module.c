@@ -0,0 +1,369 @@
+#include "upload_module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    VkDeviceSize stagingEnd; // Ring position after the batch's last copy
+} UploadBatch;
+
+typedef struct {
+    VkCommandPool commandPool; // On the transfer queue family
+    // Ring of batches: [batchTail, batchTail + inFlightCount) are submitted, the next one records
+    UploadBatch batches[UPLOAD_MAX_BATCHES];
+    uint32_t batchTail;
+    uint32_t inFlightCount;
+    VkBool32 recording;
+    VkBuffer stagingBuffer;
+    MemoryAllocation stagingMemory;
+    // Monotonic ring positions, the staging offset is position % UPLOAD_STAGING_SIZE.
+    // [stagingTail, stagingHead) belongs to batches that have not retired yet.
+    VkDeviceSize stagingHead;
+    VkDeviceSize stagingTail;
+    VkDeviceSize batchStart; // stagingHead when the open batch began
+    VkBool32 unifiedMemory; // Device-local memory is also host visible (integrated GPUs)
+    VkBool32 ownershipTransfer; // Transfer and graphics families differ
+
+    // Release on the transfer queue, acquire on graphics; [0, releasedCount) are submitted
+    VkBufferMemoryBarrier* barriers;
+    uint32_t barrierCount;
+    uint32_t barrierCapacity;
+    uint32_t releasedCount;
+
+    // Alternating so a new batch can chain on one the graphics queue has not waited for yet
+    VkSemaphore semaphores[2];
+    uint32_t semaphoreIndex;
+    VkBool32 semaphorePending; // semaphores[semaphoreIndex] is signaled or will be, nobody waits yet
+
+    // Persistently mapped ring, one UPLOAD_FRAME_RING_SIZE segment per frame in flight
+    VkBuffer frameBuffer;
+    MemoryAllocation frameMemory;
+    uint32_t frameCount;
+    uint32_t frameIndex;
+    VkDeviceSize frameHead;
+} UploadContext;
+
+static UploadContext upCtx = {0};
+
+static VkBool32 detect_unified_memory(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkCtx->physicalDevice, &properties);
+    if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU &&
+        properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU) {
+        return VK_FALSE;
+    }
+
+    const VkPhysicalDeviceMemoryProperties* memProperties = &vkCtx->memoryProperties;
+    VkMemoryPropertyFlags wanted = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < memProperties->memoryTypeCount; i++) {
+        if ((memProperties->memoryTypes[i].propertyFlags & wanted) == wanted) {
+            return VK_TRUE;
+        }
+    }
+    return VK_FALSE;
+}
+
+void init_upload(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    memset(&upCtx, 0, sizeof(upCtx));
+
+    upCtx.unifiedMemory = detect_unified_memory();
+    upCtx.ownershipTransfer = vkCtx->transferFamily != vkCtx->graphicsFamily;
+
+    VkCommandPoolCreateInfo poolInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    poolInfo.queueFamilyIndex = vkCtx->transferFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(vkCtx->device, &poolInfo, vk_allocator(ALLOC_OBJECT_COMMAND_POOL), &upCtx.commandPool) != VK_SUCCESS) {
+        printf("Failed to create upload command pool\n");
+        exit(1);
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocInfo.commandPool = upCtx.commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VkFenceCreateInfo fenceInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    for (uint32_t i = 0; i < UPLOAD_MAX_BATCHES; i++) {
+        if (vkAllocateCommandBuffers(vkCtx->device, &allocInfo, &upCtx.batches[i].commandBuffer) != VK_SUCCESS) {
+            printf("Failed to allocate upload command buffer\n");
+            exit(1);
+        }
+        if (vkCreateFence(vkCtx->device, &fenceInfo, vk_allocator(ALLOC_OBJECT_SYNC), &upCtx.batches[i].fence) != VK_SUCCESS) {
+            printf("Failed to create upload fence\n");
+            exit(1);
+        }
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    for (uint32_t i = 0; i < 2; i++) {
+        if (vkCreateSemaphore(vkCtx->device, &semaphoreInfo, vk_allocator(ALLOC_OBJECT_SYNC), &upCtx.semaphores[i]) != VK_SUCCESS) {
+            printf("Failed to create upload semaphore\n");
+            exit(1);
+        }
+    }
+
+    memory_create_buffer(UPLOAD_STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_TAG_STAGING,
+                         &upCtx.stagingBuffer, &upCtx.stagingMemory);
+
+    upload_frame_ring_resize(MAX_FRAMES_IN_FLIGHT);
+}
+
+void cleanup_upload(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    upload_flush();
+    upload_wait();
+    memory_destroy_buffer(&upCtx.frameBuffer, &upCtx.frameMemory);
+    memory_destroy_buffer(&upCtx.stagingBuffer, &upCtx.stagingMemory);
+    heap_free(upCtx.barriers);
+    vkDestroySemaphore(vkCtx->device, upCtx.semaphores[0], vk_allocator(ALLOC_OBJECT_SYNC));
+    vkDestroySemaphore(vkCtx->device, upCtx.semaphores[1], vk_allocator(ALLOC_OBJECT_SYNC));
+    for (uint32_t i = 0; i < UPLOAD_MAX_BATCHES; i++) {
+        vkDestroyFence(vkCtx->device, upCtx.batches[i].fence, vk_allocator(ALLOC_OBJECT_SYNC));
+    }
+    vkDestroyCommandPool(vkCtx->device, upCtx.commandPool, vk_allocator(ALLOC_OBJECT_COMMAND_POOL));
+}
+
+static UploadBatch* open_batch(void) {
+    return &upCtx.batches[(upCtx.batchTail + upCtx.inFlightCount) % UPLOAD_MAX_BATCHES];
+}
+
+// Batches finish in submission order on the one queue; retiring the oldest frees its staging range
+static VkBool32 retire_batch(VkBool32 wait) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (upCtx.inFlightCount == 0) {
+        return VK_FALSE;
+    }
+    UploadBatch* batch = &upCtx.batches[upCtx.batchTail];
+    if (wait) {
+        vkWaitForFences(vkCtx->device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+    } else if (vkGetFenceStatus(vkCtx->device, batch->fence) != VK_SUCCESS) {
+        return VK_FALSE;
+    }
+    vkResetFences(vkCtx->device, 1, &batch->fence);
+    vkResetCommandBuffer(batch->commandBuffer, 0);
+    upCtx.stagingTail = batch->stagingEnd;
+    upCtx.batchTail = (upCtx.batchTail + 1) % UPLOAD_MAX_BATCHES;
+    upCtx.inFlightCount--;
+    return VK_TRUE;
+}
+
+void upload_wait(void) {
+    while (retire_batch(VK_TRUE)) {
+    }
+}
+
+static void begin_batch(void) {
+    if (upCtx.recording) {
+        return;
+    }
+    if (upCtx.inFlightCount == UPLOAD_MAX_BATCHES) {
+        retire_batch(VK_TRUE); // Every slot is busy, the oldest one is needed
+    }
+    VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(open_batch()->commandBuffer, &beginInfo) != VK_SUCCESS) {
+        printf("Failed to begin upload command buffer\n");
+        exit(1);
+    }
+    upCtx.recording = VK_TRUE;
+    upCtx.batchStart = upCtx.stagingHead;
+}
+
+// Contiguous staging space for up to size bytes at stagingHead. Blocks only when the ring has
+// wrapped onto a batch the GPU has not finished.
+static VkDeviceSize reserve_staging(VkDeviceSize size) {
+    while (retire_batch(VK_FALSE)) {
+    }
+    while (upCtx.stagingHead == upCtx.stagingTail + UPLOAD_STAGING_SIZE) {
+        if (upCtx.inFlightCount == 0) {
+            upload_flush(); // The open batch alone fills the ring
+        }
+        retire_batch(VK_TRUE);
+    }
+    VkDeviceSize offset = upCtx.stagingHead % UPLOAD_STAGING_SIZE;
+    VkDeviceSize chunk = UPLOAD_STAGING_SIZE - offset; // Up to the wrap point
+    VkDeviceSize available = upCtx.stagingTail + UPLOAD_STAGING_SIZE - upCtx.stagingHead;
+    if (chunk > available) {
+        chunk = available;
+    }
+    return chunk < size ? chunk : size;
+}
+
+static void add_barrier(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+    if (upCtx.barrierCount == upCtx.barrierCapacity) {
+        upCtx.barrierCapacity = upCtx.barrierCapacity ? upCtx.barrierCapacity * 2 : 64;
+        upCtx.barriers = heap_realloc(upCtx.barriers, upCtx.barrierCapacity * sizeof(VkBufferMemoryBarrier));
+    }
+    VulkanContext* vkCtx = get_vulkan_context();
+    VkBufferMemoryBarrier* barrier = &upCtx.barriers[upCtx.barrierCount++];
+    memset(barrier, 0, sizeof(*barrier));
+    barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier->srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier->dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    barrier->srcQueueFamilyIndex = vkCtx->transferFamily;
+    barrier->dstQueueFamilyIndex = vkCtx->graphicsFamily;
+    barrier->buffer = buffer;
+    barrier->offset = offset;
+    barrier->size = size;
+}
+
+void upload_buffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+    const char* src = data;
+    while (size > 0) {
+        VkDeviceSize chunk = reserve_staging(size);
+        begin_batch();
+
+        VkDeviceSize offset = upCtx.stagingHead % UPLOAD_STAGING_SIZE;
+        memcpy((char*)upCtx.stagingMemory.mapped + offset, src, chunk);
+        VkBufferCopy region = {offset, dstOffset, chunk};
+        vkCmdCopyBuffer(open_batch()->commandBuffer, upCtx.stagingBuffer, dst, 1, &region);
+        add_barrier(dst, dstOffset, chunk);
+
+        // Keep copy offsets 16-byte aligned (covers vertex and index data); the ring size is a
+        // multiple of 16, so the padding never crosses the wrap point
+        upCtx.stagingHead = (upCtx.stagingHead + chunk + 15) & ~(VkDeviceSize)15;
+        src += chunk;
+        dstOffset += chunk;
+        size -= chunk;
+
+        // Large uploads go out in pieces, so the GPU copies one while the CPU fills the next
+        if (size > 0 && upCtx.stagingHead - upCtx.batchStart >= UPLOAD_BATCH_SIZE) {
+            upload_flush();
+        }
+    }
+}
+
+void upload_flush(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (!upCtx.recording) {
+        return;
+    }
+    UploadBatch* batch = open_batch();
+
+    // Release the written ranges to the graphics family; the semaphore orders everything else
+    uint32_t releaseCount = upCtx.barrierCount - upCtx.releasedCount;
+    if (upCtx.ownershipTransfer && releaseCount > 0) {
+        for (uint32_t i = upCtx.releasedCount; i < upCtx.barrierCount; i++) {
+            upCtx.barriers[i].dstAccessMask = 0; // Ignored on release
+        }
+        vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                             0, 0, NULL, releaseCount, &upCtx.barriers[upCtx.releasedCount], 0, NULL);
+    }
+
+    if (vkEndCommandBuffer(batch->commandBuffer) != VK_SUCCESS) {
+        printf("Failed to end upload command buffer\n");
+        exit(1);
+    }
+
+    // Chain on the previous batch if graphics has not consumed its semaphore yet. Always
+    // signal the other semaphore: a frame being recorded may still be about to wait on this one.
+    VkSemaphore waitSemaphore = upCtx.semaphores[upCtx.semaphoreIndex];
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    uint32_t signalIndex = upCtx.semaphoreIndex ^ 1;
+
+    VkSubmitInfo submitInfo = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submitInfo.waitSemaphoreCount = upCtx.semaphorePending ? 1 : 0;
+    submitInfo.pWaitSemaphores = &waitSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch->commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &upCtx.semaphores[signalIndex];
+    vulkan_lock_queue(); // transferQueue may alias graphicsQueue
+    if (vkQueueSubmit(vkCtx->transferQueue, 1, &submitInfo, batch->fence) != VK_SUCCESS) {
+        printf("Failed to submit upload command buffer\n");
+        exit(1);
+    }
+    vulkan_unlock_queue();
+
+    upCtx.semaphoreIndex = signalIndex;
+    upCtx.semaphorePending = VK_TRUE;
+    upCtx.releasedCount = upCtx.barrierCount;
+    upCtx.recording = VK_FALSE;
+    batch->stagingEnd = upCtx.stagingHead;
+    upCtx.inFlightCount++;
+}
+
+VkBool32 upload_acquire(VkCommandBuffer commandBuffer, VkSemaphore* waitSemaphore) {
+    if (!upCtx.semaphorePending) {
+        return VK_FALSE;
+    }
+
+    // Matching acquire half of the ownership transfer
+    if (upCtx.ownershipTransfer && upCtx.releasedCount > 0) {
+        for (uint32_t i = 0; i < upCtx.releasedCount; i++) {
+            upCtx.barriers[i].srcAccessMask = 0; // Ignored on acquire
+            upCtx.barriers[i].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, NULL, upCtx.releasedCount, upCtx.barriers, 0, NULL);
+    }
+
+    // Keep barriers of a batch that is still being recorded
+    memmove(upCtx.barriers, &upCtx.barriers[upCtx.releasedCount],
+            (upCtx.barrierCount - upCtx.releasedCount) * sizeof(VkBufferMemoryBarrier));
+    upCtx.barrierCount -= upCtx.releasedCount;
+    upCtx.releasedCount = 0;
+
+    *waitSemaphore = upCtx.semaphores[upCtx.semaphoreIndex];
+    upCtx.semaphorePending = VK_FALSE;
+    return VK_TRUE;
+}
+
+void upload_create_buffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, MemoryTag tag, VkBuffer* buffer, MemoryAllocation* allocation) {
+    if (upCtx.unifiedMemory) {
+        memory_create_buffer(size, usage,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             tag, buffer, allocation);
+        memcpy(allocation->mapped, data, size);
+        return;
+    }
+
+    memory_create_buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tag, buffer, allocation);
+    upload_buffer(*buffer, 0, data, size);
+}
+
+// Must only be called while the device is idle (init or swapchain recreation)
+void upload_frame_ring_resize(uint32_t frameCount) {
+    if (frameCount <= upCtx.frameCount) {
+        return;
+    }
+    memory_destroy_buffer(&upCtx.frameBuffer, &upCtx.frameMemory);
+    memory_create_buffer((VkDeviceSize)UPLOAD_FRAME_RING_SIZE * frameCount,
+                         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_TAG_GEOMETRY,
+                         &upCtx.frameBuffer, &upCtx.frameMemory);
+    upCtx.frameCount = frameCount;
+    upCtx.frameIndex = 0;
+    upCtx.frameHead = 0;
+}
+
+void upload_frame_begin(uint32_t frameIndex) {
+    // The GPU is done with this segment, so everything in it can be overwritten
+    upCtx.frameIndex = frameIndex % upCtx.frameCount;
+    upCtx.frameHead = 0;
+}
+
+VkBool32 upload_frame_alloc(VkDeviceSize size, VkDeviceSize alignment, FrameAllocation* allocation) {
+    VkDeviceSize offset = upCtx.frameHead;
+    if (alignment > 1) {
+        offset = (offset + alignment - 1) & ~(alignment - 1);
+    }
+    if (offset + size > UPLOAD_FRAME_RING_SIZE) {
+        printf("Frame upload ring exhausted (%llu bytes requested)\n", (unsigned long long)size);
+        return VK_FALSE;
+    }
+    upCtx.frameHead = offset + size;
+
+    VkDeviceSize base = (VkDeviceSize)upCtx.frameIndex * UPLOAD_FRAME_RING_SIZE;
+    allocation->buffer = upCtx.frameBuffer;
+    allocation->offset = base + offset;
+    allocation->data = (char*)upCtx.frameMemory.mapped + base + offset;
+    return VK_TRUE;
+}
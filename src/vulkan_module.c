@@ -1,8 +1,18 @@
 // 
 
 #include "vulkan_module.h"
+#include "upload_module.h"
+#include "geometry_module.h"
+#include "defer_module.h"
+#include "record_module.h"
+#include "graph_module.h"
+#include "cull_module.h"
+#include "encoder_module.h"
 #include "triangle_vert.h" // Include vertex shader array
 #include "triangle_frag.h" // Include fragment shader array
+#include "quad_instanced_vert.h"
+#include "triangle_module.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,20 +22,61 @@
 
 // Global Vulkan context
 static VulkanContext vkCtx = {0};
+static CommandEncoder frameEncoder; // Records the primary of the frame in progress
+static VkSemaphore uploadWaitSemaphore = VK_NULL_HANDLE; // Set by vulkan_begin_frame when uploads landed
+static PFN_vkWaitSemaphoresKHR waitSemaphores = NULL;
+static PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = NULL;
 
 uint32_t find_memory_type(VulkanContext* ctx, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(ctx->physicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
+    const VkPhysicalDeviceMemoryProperties* memProperties = &ctx->memoryProperties;
+
+    // Prefer the first matching type whose heap still has budget headroom
+    uint32_t firstMatch = UINT32_MAX;
+    for (uint32_t i = 0; i < memProperties->memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i)) && (memProperties->memoryTypes[i].propertyFlags & properties) == properties) {
+            if (memory_heap_has_headroom(memProperties->memoryTypes[i].heapIndex)) {
+                return i;
+            }
+            if (firstMatch == UINT32_MAX) {
+                firstMatch = i;
+            }
         }
     }
+    if (firstMatch != UINT32_MAX) {
+        return firstMatch;
+    }
     printf("Failed to find suitable memory type!\n");
     exit(1);
 }
 
+static VkBool32 instance_extension_supported(const char* name) {
+    uint32_t count = 0;
+    vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+    ScratchScope scratch = scratch_begin();
+    VkExtensionProperties* properties = scratch_alloc(count * sizeof(VkExtensionProperties));
+    vkEnumerateInstanceExtensionProperties(NULL, &count, properties);
+    VkBool32 found = VK_FALSE;
+    for (uint32_t i = 0; i < count && !found; i++) {
+        found = strcmp(properties[i].extensionName, name) == 0;
+    }
+    scratch_end(scratch);
+    return found;
+}
+
+static VkBool32 device_extension_supported(VkPhysicalDevice physicalDevice, const char* name) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &count, NULL);
+    ScratchScope scratch = scratch_begin();
+    VkExtensionProperties* properties = scratch_alloc(count * sizeof(VkExtensionProperties));
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &count, properties);
+    VkBool32 found = VK_FALSE;
+    for (uint32_t i = 0; i < count && !found; i++) {
+        found = strcmp(properties[i].extensionName, name) == 0;
+    }
+    scratch_end(scratch);
+    return found;
+}
+
 // Accessor function
 VulkanContext* get_vulkan_context(void) {
     return &vkCtx;
@@ -42,134 +93,216 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL vulkan_debug_callback_function(
 
 
 
-void recreate_swapchain(SDL_Window* window) {
+// renderFinished is per image: a present may still wait on it after the frame's fence signals
+static void create_image_semaphores(void) {
     VulkanContext* vkCtx = get_vulkan_context();
-    vkDeviceWaitIdle(vkCtx->device);
-
-    // Destroy old swapchain resources
+    VkSemaphoreCreateInfo semaphoreInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
     for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
-        vkDestroyFramebuffer(vkCtx->device, vkCtx->swapchainFramebuffers[i], NULL);
-        vkDestroyImageView(vkCtx->device, vkCtx->swapchainImageViews[i], NULL);
+        if (vkCreateSemaphore(vkCtx->device, &semaphoreInfo, vk_allocator(ALLOC_OBJECT_SYNC), &vkCtx->renderFinishedSemaphores[i]) != VK_SUCCESS) {
+            printf("Failed to create semaphores or fences\n");
+            exit(1);
+        }
+        vkCtx->imagesInFlight[i] = 0;
     }
-    free(vkCtx->swapchainFramebuffers);
-    free(vkCtx->swapchainImages);
-    free(vkCtx->swapchainImageViews);
+}
 
-    // Free old command buffers
-    vkFreeCommandBuffers(vkCtx->device, vkCtx->commandPool, vkCtx->imageCount, vkCtx->commandBuffers);
-    free(vkCtx->commandBuffers);
+// Prefer the formats we have always rendered in (UNORM, sRGB nonlinear) but only if the surface
+// lists them; otherwise take its first entry, which is the one it composites without conversion
+static void choose_surface_format(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(vkCtx->physicalDevice, vkCtx->surface, &formatCount, NULL);
+    if (formatCount == 0) {
+        printf("Surface reports no formats\n");
+        exit(1);
+    }
+    ScratchScope scratch = scratch_begin();
+    VkSurfaceFormatKHR* formats = scratch_alloc(formatCount * sizeof(VkSurfaceFormatKHR));
+    vkGetPhysicalDeviceSurfaceFormatsKHR(vkCtx->physicalDevice, vkCtx->surface, &formatCount, formats);
+
+    vkCtx->surfaceFormat = formats[0];
+    if (formatCount == 1 && formats[0].format == VK_FORMAT_UNDEFINED) {
+        vkCtx->surfaceFormat.format = VK_FORMAT_B8G8R8A8_UNORM; // Surface has no preference
+        vkCtx->surfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    } else {
+        const VkFormat preferred[] = {VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM};
+        VkBool32 found = VK_FALSE;
+        for (uint32_t p = 0; p < 2 && !found; p++) {
+            for (uint32_t i = 0; i < formatCount; i++) {
+                if (formats[i].format == preferred[p] && formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                    vkCtx->surfaceFormat = formats[i];
+                    found = VK_TRUE;
+                    break;
+                }
+            }
+        }
+    }
+    scratch_end(scratch);
+    printf("Surface format %d, color space %d\n", vkCtx->surfaceFormat.format, vkCtx->surfaceFormat.colorSpace);
+}
 
-    // Destroy old semaphores and fences
-    for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
-        vkDestroySemaphore(vkCtx->device, vkCtx->imageAvailableSemaphores[i], NULL);
-        vkDestroySemaphore(vkCtx->device, vkCtx->renderFinishedSemaphores[i], NULL);
-        vkDestroyFence(vkCtx->device, vkCtx->inFlightFences[i], NULL);
+// Swapchain, image views and framebuffers from the current surface capabilities
+static void create_swapchain(SDL_Window* window, VkSwapchainKHR oldSwapchain) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    VkSurfaceCapabilitiesKHR caps;
+    if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkCtx->physicalDevice, vkCtx->surface, &caps) != VK_SUCCESS) {
+        printf("Failed to query surface capabilities\n");
+        exit(1);
+    }
+
+    // The surface dictates the extent unless it reports the 0xFFFFFFFF wildcard
+    VkExtent2D extent = caps.currentExtent;
+    if (extent.width == UINT32_MAX) {
+        int width, height;
+        SDL_GetWindowSizeInPixels(window, &width, &height);
+        extent.width = SDL_clamp((uint32_t)width, caps.minImageExtent.width, caps.maxImageExtent.width);
+        extent.height = SDL_clamp((uint32_t)height, caps.minImageExtent.height, caps.maxImageExtent.height);
     }
-    free(vkCtx->imageAvailableSemaphores);
-    free(vkCtx->renderFinishedSemaphores);
-    free(vkCtx->inFlightFences);
+    vkCtx->width = extent.width;
+    vkCtx->height = extent.height;
 
-    // Get new window size
-    int width, height;
-    SDL_GetWindowSize(window, &width, &height);
-    vkCtx->width = (uint32_t)width;
-    vkCtx->height = (uint32_t)height;
+    uint32_t imageCount = vkCtx->bufferedImages > caps.minImageCount ? vkCtx->bufferedImages : caps.minImageCount;
+    if (caps.maxImageCount > 0 && imageCount > caps.maxImageCount) {
+        imageCount = caps.maxImageCount;
+    }
+    if (imageCount > MAX_SWAPCHAIN_IMAGES) {
+        imageCount = MAX_SWAPCHAIN_IMAGES;
+    }
+
+    const VkCompositeAlphaFlagBitsKHR alphaModes[] = {
+        VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR, VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
+        VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR, VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR
+    };
+    VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    for (uint32_t i = 0; i < 4; i++) {
+        if (caps.supportedCompositeAlpha & alphaModes[i]) {
+            compositeAlpha = alphaModes[i];
+            break;
+        }
+    }
 
-    // Recreate swapchain
     VkSwapchainCreateInfoKHR swapchainInfo = {VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
     swapchainInfo.surface = vkCtx->surface;
-    swapchainInfo.minImageCount = 2;
-    swapchainInfo.imageFormat = VK_FORMAT_B8G8R8A8_UNORM;
-    swapchainInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-    swapchainInfo.imageExtent.width = vkCtx->width;
-    swapchainInfo.imageExtent.height = vkCtx->height;
+    swapchainInfo.minImageCount = imageCount;
+    swapchainInfo.imageFormat = vkCtx->surfaceFormat.format;
+    swapchainInfo.imageColorSpace = vkCtx->surfaceFormat.colorSpace;
+    swapchainInfo.imageExtent = extent;
     swapchainInfo.imageArrayLayers = 1;
     swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    swapchainInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-    swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchainInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    // Blit target for a scene rendered below window size, see the render scale
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(vkCtx->physicalDevice, vkCtx->surfaceFormat.format, &formatProperties);
+    VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    vkCtx->scaledRenderSupported = (caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) &&
+                                   (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+    if (vkCtx->scaledRenderSupported) {
+        swapchainInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    swapchainInfo.preTransform = caps.currentTransform; // No extra rotation pass in the compositor
+    swapchainInfo.compositeAlpha = compositeAlpha;
+    swapchainInfo.presentMode = vkCtx->presentMode;
     swapchainInfo.clipped = VK_TRUE;
-    swapchainInfo.oldSwapchain = vkCtx->swapchain;
+    swapchainInfo.oldSwapchain = oldSwapchain;
 
-    if (vkCreateSwapchainKHR(vkCtx->device, &swapchainInfo, NULL, &vkCtx->swapchain) != VK_SUCCESS) {
-        printf("Failed to recreate swapchain\n");
+    if (vkCreateSwapchainKHR(vkCtx->device, &swapchainInfo, vk_allocator(ALLOC_OBJECT_SWAPCHAIN), &vkCtx->swapchain) != VK_SUCCESS) {
+        printf("Failed to create swapchain\n");
         exit(1);
     }
 
-    vkDestroySwapchainKHR(vkCtx->device, swapchainInfo.oldSwapchain, NULL);
-
-    // Get new swapchain images
     vkGetSwapchainImagesKHR(vkCtx->device, vkCtx->swapchain, &vkCtx->imageCount, NULL);
-    vkCtx->swapchainImages = malloc(vkCtx->imageCount * sizeof(VkImage));
+    if (vkCtx->imageCount > MAX_SWAPCHAIN_IMAGES) {
+        printf("Swapchain has %u images, more than MAX_SWAPCHAIN_IMAGES (%d)\n", vkCtx->imageCount, MAX_SWAPCHAIN_IMAGES);
+        exit(1);
+    }
     vkGetSwapchainImagesKHR(vkCtx->device, vkCtx->swapchain, &vkCtx->imageCount, vkCtx->swapchainImages);
 
-    // Create new image views
-    vkCtx->swapchainImageViews = malloc(vkCtx->imageCount * sizeof(VkImageView));
+    // Create image views
     for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
         VkImageViewCreateInfo viewInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
         viewInfo.image = vkCtx->swapchainImages[i];
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = VK_FORMAT_B8G8R8A8_UNORM;
+        viewInfo.format = vkCtx->surfaceFormat.format;
         viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         viewInfo.subresourceRange.baseMipLevel = 0;
         viewInfo.subresourceRange.levelCount = 1;
         viewInfo.subresourceRange.baseArrayLayer = 0;
         viewInfo.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(vkCtx->device, &viewInfo, NULL, &vkCtx->swapchainImageViews[i]) != VK_SUCCESS) {
+        if (vkCreateImageView(vkCtx->device, &viewInfo, vk_allocator(ALLOC_OBJECT_IMAGE_VIEW), &vkCtx->swapchainImageViews[i]) != VK_SUCCESS) {
             printf("Failed to create image view\n");
             exit(1);
         }
     }
+}
 
-    // Create new framebuffers
-    vkCtx->swapchainFramebuffers = malloc(vkCtx->imageCount * sizeof(VkFramebuffer));
+void recreate_swapchain(SDL_Window* window) {
+    VulkanContext* vkCtx = get_vulkan_context();
+
+    // Hand the old swapchain and everything built on it to the deferred destroy queue. Presents
+    // are queued ahead of the next frame's submit, so once that frame completes nothing uses them.
+    // Per-frame command buffers and sync objects do not depend on the extent and are kept.
+    graph_invalidate();
     for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
-        VkFramebufferCreateInfo framebufferInfo = {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
-        framebufferInfo.renderPass = vkCtx->renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = &vkCtx->swapchainImageViews[i];
-        framebufferInfo.width = vkCtx->width;
-        framebufferInfo.height = vkCtx->height;
-        framebufferInfo.layers = 1;
-
-        if (vkCreateFramebuffer(vkCtx->device, &framebufferInfo, NULL, &vkCtx->swapchainFramebuffers[i]) != VK_SUCCESS) {
-            printf("Failed to create framebuffer\n");
-            exit(1);
-        }
+        vk_defer_destroy((uint64_t)vkCtx->swapchainImageViews[i], VK_OBJECT_TYPE_IMAGE_VIEW);
+        vk_defer_destroy((uint64_t)vkCtx->renderFinishedSemaphores[i], VK_OBJECT_TYPE_SEMAPHORE);
     }
+    VkSwapchainKHR oldSwapchain = vkCtx->swapchain;
 
-    // Allocate new command buffers
-    vkCtx->commandBuffers = malloc(vkCtx->imageCount * sizeof(VkCommandBuffer));
-    VkCommandBufferAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    allocInfo.commandPool = vkCtx->commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = vkCtx->imageCount;
-    if (vkAllocateCommandBuffers(vkCtx->device, &allocInfo, vkCtx->commandBuffers) != VK_SUCCESS) {
-        printf("Failed to allocate command buffers\n");
+    create_swapchain(window, oldSwapchain);
+    vk_defer_destroy((uint64_t)oldSwapchain, VK_OBJECT_TYPE_SWAPCHAIN_KHR);
+
+    // Fresh per-image present semaphores, the old ones may still be waited on by a present
+    create_image_semaphores();
+}
+
+// Variant of the triangle pipeline described by baseInfo: the vertex stage also reads a QuadInstance
+// per instance, so any number of quads go out in one draw
+static void create_instanced_pipeline(const VkGraphicsPipelineCreateInfo* baseInfo) {
+    VulkanContext* vkCtx = get_vulkan_context();
+
+    VkShaderModuleCreateInfo shaderInfo = {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+    shaderInfo.codeSize = sizeof(quad_instanced_vert_spv);
+    shaderInfo.pCode = quad_instanced_vert_spv;
+    VkShaderModule vertModule;
+    if (vkCreateShaderModule(vkCtx->device, &shaderInfo, vk_allocator(ALLOC_OBJECT_SHADER_MODULE), &vertModule) != VK_SUCCESS) {
+        printf("Failed to create instanced vertex shader module\n");
         exit(1);
     }
 
-    // Recreate semaphores and fences
-    vkCtx->imageAvailableSemaphores = malloc(vkCtx->imageCount * sizeof(VkSemaphore));
-    vkCtx->renderFinishedSemaphores = malloc(vkCtx->imageCount * sizeof(VkSemaphore));
-    vkCtx->inFlightFences = malloc(vkCtx->imageCount * sizeof(VkFence));
+    // Fragment stage is shared, it only sees the interpolated color
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {baseInfo->pStages[0], baseInfo->pStages[1]};
+    shaderStages[0].module = vertModule;
 
-    VkSemaphoreCreateInfo semaphoreInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
-    VkFenceCreateInfo fenceInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VkVertexInputBindingDescription bindingDesc[] = {
+        {0, 6 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX},
+        {1, sizeof(QuadInstance), VK_VERTEX_INPUT_RATE_INSTANCE}
+    };
+    VkVertexInputAttributeDescription attrDesc[] = {
+        {0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0},
+        {1, 0, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float)},
+        {2, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(QuadInstance, offset)},
+        {3, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(QuadInstance, scale)},
+        {4, 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(QuadInstance, color)},
+        {5, 1, VK_FORMAT_R32_SFLOAT, offsetof(QuadInstance, rotation)}
+    };
 
-    for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
-        if (vkCreateSemaphore(vkCtx->device, &semaphoreInfo, NULL, &vkCtx->imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(vkCtx->device, &semaphoreInfo, NULL, &vkCtx->renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(vkCtx->device, &fenceInfo, NULL, &vkCtx->inFlightFences[i]) != VK_SUCCESS) {
-            printf("Failed to create semaphores or fences\n");
-            exit(1);
-        }
-    }
-}
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
+    vertexInputInfo.vertexBindingDescriptionCount = 2;
+    vertexInputInfo.pVertexBindingDescriptions = bindingDesc;
+    vertexInputInfo.vertexAttributeDescriptionCount = 6;
+    vertexInputInfo.pVertexAttributeDescriptions = attrDesc;
 
+    VkGraphicsPipelineCreateInfo pipelineInfo = *baseInfo;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    if (vkCreateGraphicsPipelines(vkCtx->device, VK_NULL_HANDLE, 1, &pipelineInfo, vk_allocator(ALLOC_OBJECT_PIPELINE), &vkCtx->instancedPipeline) != VK_SUCCESS) {
+        printf("Failed to create instanced pipeline\n");
+        exit(1);
+    }
 
+    vkDestroyShaderModule(vkCtx->device, vertModule, vk_allocator(ALLOC_OBJECT_SHADER_MODULE));
+}
 
 void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
     VulkanContext* vkCtx = get_vulkan_context();
@@ -191,12 +324,19 @@ void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
     // Add debug utils extension
     const char* additionalExtensions[] = {"VK_EXT_debug_utils"};
     uint32_t extensionCount = sdlExtensionCount + 1;
-    const char** extensions = malloc(extensionCount * sizeof(const char*));
+    ScratchScope scratch = scratch_begin(); // Init-time temporaries, released once the device is picked
+    const char** extensions = scratch_alloc((extensionCount + 1) * sizeof(const char*));
     for (uint32_t i = 0; i < sdlExtensionCount; i++) {
         extensions[i] = sdlExtensions[i];
     }
     extensions[sdlExtensionCount] = "VK_EXT_debug_utils";
 
+    // Needed by VK_EXT_memory_budget and VK_KHR_timeline_semaphore on a 1.0 instance
+    VkBool32 properties2Supported = instance_extension_supported(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    if (properties2Supported) {
+        extensions[extensionCount++] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+    }
+
     const char* validationLayers[] = {"VK_LAYER_KHRONOS_validation"};
     uint32_t layerCount = 1;
 
@@ -207,11 +347,10 @@ void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
     createInfo.enabledLayerCount = layerCount;
     createInfo.ppEnabledLayerNames = validationLayers;
 
-    if (vkCreateInstance(&createInfo, NULL, &vkCtx->instance) != VK_SUCCESS) {
+    if (vkCreateInstance(&createInfo, vk_allocator(ALLOC_OBJECT_INSTANCE), &vkCtx->instance) != VK_SUCCESS) {
         printf("Failed to create Vulkan instance\n");
         exit(1);
     }
-    free(extensions);
 
     // Setup debug messenger
     VkDebugUtilsMessengerCreateInfoEXT debugInfo = {VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT};
@@ -224,12 +363,12 @@ void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
     debugInfo.pfnUserCallback = vulkan_debug_callback_function;
 
     PFN_vkCreateDebugUtilsMessengerEXT createDebugMessenger = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(vkCtx->instance, "vkCreateDebugUtilsMessengerEXT");
-    if (createDebugMessenger && createDebugMessenger(vkCtx->instance, &debugInfo, NULL, &vkCtx->debugMessenger) != VK_SUCCESS) {
+    if (createDebugMessenger && createDebugMessenger(vkCtx->instance, &debugInfo, vk_allocator(ALLOC_OBJECT_DEBUG), &vkCtx->debugMessenger) != VK_SUCCESS) {
         printf("Failed to set up debug messenger\n");
     }
 
     // Create surface
-    if (!SDL_Vulkan_CreateSurface(window, vkCtx->instance, NULL, &vkCtx->surface)) {
+    if (!SDL_Vulkan_CreateSurface(window, vkCtx->instance, vk_allocator(ALLOC_OBJECT_SURFACE), &vkCtx->surface)) {
         printf("Failed to create Vulkan surface: %s\n", SDL_GetError());
         exit(1);
     }
@@ -237,15 +376,17 @@ void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
     // Pick physical device
     uint32_t deviceCount = 0;
     vkEnumeratePhysicalDevices(vkCtx->instance, &deviceCount, NULL);
-    VkPhysicalDevice* devices = malloc(deviceCount * sizeof(VkPhysicalDevice));
+    VkPhysicalDevice* devices = scratch_alloc(deviceCount * sizeof(VkPhysicalDevice));
     vkEnumeratePhysicalDevices(vkCtx->instance, &deviceCount, devices);
     vkCtx->physicalDevice = devices[0]; // Simplistic selection
-    free(devices);
+
+    // Memory properties never change for a physical device, query them once
+    vkGetPhysicalDeviceMemoryProperties(vkCtx->physicalDevice, &vkCtx->memoryProperties);
 
     // Find queue family
     uint32_t queueFamilyCount = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(vkCtx->physicalDevice, &queueFamilyCount, NULL);
-    VkQueueFamilyProperties* queueFamilies = malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+    VkQueueFamilyProperties* queueFamilies = scratch_alloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
     vkGetPhysicalDeviceQueueFamilyProperties(vkCtx->physicalDevice, &queueFamilyCount, queueFamilies);
 
     uint32_t graphicsFamily = UINT32_MAX;
@@ -257,82 +398,134 @@ void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
             if (surfaceSupport) break;
         }
     }
-    free(queueFamilies);
+
+    // Prefer a transfer-only family (DMA engine), then any non-graphics one with transfer support
+    uint32_t transferFamily = graphicsFamily;
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+            continue;
+        }
+        if (!(flags & VK_QUEUE_COMPUTE_BIT)) {
+            transferFamily = i;
+            break;
+        }
+        if (transferFamily == graphicsFamily) {
+            transferFamily = i;
+        }
+    }
+    scratch_end(scratch);
 
     if (graphicsFamily == UINT32_MAX || !surfaceSupport) {
         printf("Failed to find suitable queue family\n");
         exit(1);
     }
+    vkCtx->graphicsFamily = graphicsFamily;
+    vkCtx->transferFamily = transferFamily;
 
     // Create logical device
     float queuePriority = 1.0f;
-    VkDeviceQueueCreateInfo queueCreateInfo = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-    queueCreateInfo.queueFamilyIndex = graphicsFamily;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &queuePriority;
+    VkDeviceQueueCreateInfo queueCreateInfos[2] = {{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO}, {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO}};
+    queueCreateInfos[0].queueFamilyIndex = graphicsFamily;
+    queueCreateInfos[0].queueCount = 1;
+    queueCreateInfos[0].pQueuePriorities = &queuePriority;
+    queueCreateInfos[1].queueFamilyIndex = transferFamily;
+    queueCreateInfos[1].queueCount = 1;
+    queueCreateInfos[1].pQueuePriorities = &queuePriority;
+    uint32_t queueCreateInfoCount = transferFamily != graphicsFamily ? 2 : 1;
+
+    const char* deviceExtensions[8] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    uint32_t deviceExtensionCount = 1;
+    vkCtx->memoryBudgetSupported = properties2Supported &&
+        device_extension_supported(vkCtx->physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (vkCtx->memoryBudgetSupported) {
+        deviceExtensions[deviceExtensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+
+    // Optional features, queried through one vkGetPhysicalDeviceFeatures2KHR chain. Timeline
+    // semaphores are core in 1.2; the KHR extension gives us the same thing on a 1.0 instance.
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES};
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR};
+    VkBool32 timelineExtension = properties2Supported &&
+        device_extension_supported(vkCtx->physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    VkBool32 presentWaitExtensions = properties2Supported &&
+        device_extension_supported(vkCtx->physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+        device_extension_supported(vkCtx->physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = properties2Supported ?
+        (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(vkCtx->instance, "vkGetPhysicalDeviceFeatures2KHR") : NULL;
+    if (getFeatures2 && (timelineExtension || presentWaitExtensions)) {
+        VkPhysicalDeviceFeatures2 features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+        presentIdFeatures.pNext = &presentWaitFeatures;
+        timelineFeatures.pNext = presentWaitExtensions ? &presentIdFeatures : NULL;
+        features2.pNext = timelineExtension ? (void*)&timelineFeatures : (void*)&presentIdFeatures;
+        getFeatures2(vkCtx->physicalDevice, &features2);
+    }
+    vkCtx->timelineSupported = timelineExtension && timelineFeatures.timelineSemaphore;
+    vkCtx->presentWaitSupported = presentWaitExtensions && presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+
+    // Enable only what we are going to use
+    void* enabledFeatures = NULL;
+    if (vkCtx->presentWaitSupported) {
+        presentWaitFeatures.pNext = NULL;
+        presentIdFeatures.pNext = &presentWaitFeatures;
+        enabledFeatures = &presentIdFeatures;
+        deviceExtensions[deviceExtensionCount++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+        deviceExtensions[deviceExtensionCount++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+    }
+    if (vkCtx->timelineSupported) {
+        timelineFeatures.pNext = enabledFeatures;
+        enabledFeatures = &timelineFeatures;
+        deviceExtensions[deviceExtensionCount++] = VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME;
+    }
 
-    const char* deviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
     VkDeviceCreateInfo deviceCreateInfo = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-    deviceCreateInfo.queueCreateInfoCount = 1;
-    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-    deviceCreateInfo.enabledExtensionCount = 1;
+    deviceCreateInfo.pNext = enabledFeatures;
+    deviceCreateInfo.queueCreateInfoCount = queueCreateInfoCount;
+    deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
+    deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
     deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions;
     deviceCreateInfo.enabledLayerCount = layerCount;
     deviceCreateInfo.ppEnabledLayerNames = validationLayers;
 
-    if (vkCreateDevice(vkCtx->physicalDevice, &deviceCreateInfo, NULL, &vkCtx->device) != VK_SUCCESS) {
+    if (vkCreateDevice(vkCtx->physicalDevice, &deviceCreateInfo, vk_allocator(ALLOC_OBJECT_DEVICE), &vkCtx->device) != VK_SUCCESS) {
         printf("Failed to create logical device\n");
         exit(1);
     }
 
     vkGetDeviceQueue(vkCtx->device, graphicsFamily, 0, &vkCtx->graphicsQueue);
-
-    // Create swapchain
-    VkSwapchainCreateInfoKHR swapchainInfo = {VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
-    swapchainInfo.surface = vkCtx->surface;
-    swapchainInfo.minImageCount = 2;
-    swapchainInfo.imageFormat = VK_FORMAT_B8G8R8A8_UNORM;
-    swapchainInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-    swapchainInfo.imageExtent.width = width;
-    swapchainInfo.imageExtent.height = height;
-    swapchainInfo.imageArrayLayers = 1;
-    swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    swapchainInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-    swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchainInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    swapchainInfo.clipped = VK_TRUE;
-
-    if (vkCreateSwapchainKHR(vkCtx->device, &swapchainInfo, NULL, &vkCtx->swapchain) != VK_SUCCESS) {
-        printf("Failed to create swapchain\n");
+    vkGetDeviceQueue(vkCtx->device, transferFamily, 0, &vkCtx->transferQueue);
+    vkCtx->queueLock = SDL_CreateMutex();
+    if (!vkCtx->queueLock) {
+        printf("Failed to create queue lock: %s\n", SDL_GetError());
         exit(1);
     }
 
-    vkGetSwapchainImagesKHR(vkCtx->device, vkCtx->swapchain, &vkCtx->imageCount, NULL);
-    vkCtx->swapchainImages = malloc(vkCtx->imageCount * sizeof(VkImage));
-    vkGetSwapchainImagesKHR(vkCtx->device, vkCtx->swapchain, &vkCtx->imageCount, vkCtx->swapchainImages);
+    if (vkCtx->timelineSupported) {
+        waitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(vkCtx->device, "vkWaitSemaphoresKHR");
+        getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(vkCtx->device, "vkGetSemaphoreCounterValueKHR");
+        vkCtx->timelineSupported = waitSemaphores && getSemaphoreCounterValue;
+    }
 
-    // Create image views
-    vkCtx->swapchainImageViews = malloc(vkCtx->imageCount * sizeof(VkImageView));
-    for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
-        VkImageViewCreateInfo viewInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-        viewInfo.image = vkCtx->swapchainImages[i];
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = VK_FORMAT_B8G8R8A8_UNORM;
-        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
-        viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = 1;
+    // Device memory sub-allocator
+    init_memory();
 
-        if (vkCreateImageView(vkCtx->device, &viewInfo, NULL, &vkCtx->swapchainImageViews[i]) != VK_SUCCESS) {
-            printf("Failed to create image view\n");
-            exit(1);
-        }
+    // Present modes the surface supports; FIFO is always among them and stays the default
+    vkCtx->presentModeCount = MAX_PRESENT_MODES;
+    if (vkGetPhysicalDeviceSurfacePresentModesKHR(vkCtx->physicalDevice, vkCtx->surface, &vkCtx->presentModeCount, vkCtx->presentModes) < 0) {
+        vkCtx->presentModeCount = 0;
     }
+    vkCtx->presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    memset(vkCtx->presentLatency, 0, sizeof(vkCtx->presentLatency));
+
+    // Format is picked once, the render pass and pipeline depend on it
+    choose_surface_format();
+    vkCtx->bufferedImages = MIN_BUFFERED_IMAGES;
 
-    // Create render pass
+    // Create render pass. Never begun: pipelines, ImGui and secondaries are built against it, and
+    // the graph's render passes with the same attachment formats are compatible with it
     VkAttachmentDescription colorAttachment = {};
-    colorAttachment.format = VK_FORMAT_B8G8R8A8_UNORM;
+    colorAttachment.format = vkCtx->surfaceFormat.format;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -366,14 +559,14 @@ void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
 
-    if (vkCreateRenderPass(vkCtx->device, &renderPassInfo, NULL, &vkCtx->renderPass) != VK_SUCCESS) {
+    if (vkCreateRenderPass(vkCtx->device, &renderPassInfo, vk_allocator(ALLOC_OBJECT_RENDER_PASS), &vkCtx->renderPass) != VK_SUCCESS) {
         printf("Failed to create render pass\n");
         exit(1);
     }
 
     // Create pipeline layout
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-    if (vkCreatePipelineLayout(vkCtx->device, &pipelineLayoutInfo, NULL, &vkCtx->pipelineLayout) != VK_SUCCESS) {
+    if (vkCreatePipelineLayout(vkCtx->device, &pipelineLayoutInfo, vk_allocator(ALLOC_OBJECT_PIPELINE), &vkCtx->pipelineLayout) != VK_SUCCESS) {
         printf("Failed to create pipeline layout\n");
         exit(1);
     }
@@ -383,13 +576,13 @@ void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
     VkShaderModuleCreateInfo shaderInfo = {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
     shaderInfo.codeSize = sizeof(triangle_vert_spv);
     shaderInfo.pCode = triangle_vert_spv;
-    if (vkCreateShaderModule(vkCtx->device, &shaderInfo, NULL, &vertShaderModule) != VK_SUCCESS) {
+    if (vkCreateShaderModule(vkCtx->device, &shaderInfo, vk_allocator(ALLOC_OBJECT_SHADER_MODULE), &vertShaderModule) != VK_SUCCESS) {
         printf("Failed to create vertex shader module\n");
         exit(1);
     }
     shaderInfo.codeSize = sizeof(triangle_frag_spv);
     shaderInfo.pCode = triangle_frag_spv;
-    if (vkCreateShaderModule(vkCtx->device, &shaderInfo, NULL, &fragShaderModule) != VK_SUCCESS) {
+    if (vkCreateShaderModule(vkCtx->device, &shaderInfo, vk_allocator(ALLOC_OBJECT_SHADER_MODULE), &fragShaderModule) != VK_SUCCESS) {
         printf("Failed to create fragment shader module\n");
         exit(1);
     }
@@ -463,68 +656,74 @@ void init_vulkan(SDL_Window* window, uint32_t width, uint32_t height) {
     pipelineInfo.renderPass = vkCtx->renderPass;
     pipelineInfo.subpass = 0;
 
-    if (vkCreateGraphicsPipelines(vkCtx->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &vkCtx->graphicsPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(vkCtx->device, VK_NULL_HANDLE, 1, &pipelineInfo, vk_allocator(ALLOC_OBJECT_PIPELINE), &vkCtx->graphicsPipeline) != VK_SUCCESS) {
         printf("Failed to create graphics pipeline\n");
         exit(1);
     }
+    create_instanced_pipeline(&pipelineInfo);
 
-    vkDestroyShaderModule(vkCtx->device, vertShaderModule, NULL);
-    vkDestroyShaderModule(vkCtx->device, fragShaderModule, NULL);
+    vkDestroyShaderModule(vkCtx->device, vertShaderModule, vk_allocator(ALLOC_OBJECT_SHADER_MODULE));
+    vkDestroyShaderModule(vkCtx->device, fragShaderModule, vk_allocator(ALLOC_OBJECT_SHADER_MODULE));
 
-    // Create framebuffers
-    vkCtx->swapchainFramebuffers = malloc(vkCtx->imageCount * sizeof(VkFramebuffer));
-    for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
-        VkFramebufferCreateInfo framebufferInfo = {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
-        framebufferInfo.renderPass = vkCtx->renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = &vkCtx->swapchainImageViews[i];
-        framebufferInfo.width = width;
-        framebufferInfo.height = height;
-        framebufferInfo.layers = 1;
-
-        if (vkCreateFramebuffer(vkCtx->device, &framebufferInfo, NULL, &vkCtx->swapchainFramebuffers[i]) != VK_SUCCESS) {
-            printf("Failed to create framebuffer\n");
-            exit(1);
-        }
-    }
+    // Swapchain, image views and framebuffers
+    create_swapchain(window, VK_NULL_HANDLE);
 
     // Create command pool
     VkCommandPoolCreateInfo poolInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
     poolInfo.queueFamilyIndex = graphicsFamily;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    if (vkCreateCommandPool(vkCtx->device, &poolInfo, NULL, &vkCtx->commandPool) != VK_SUCCESS) {
+    if (vkCreateCommandPool(vkCtx->device, &poolInfo, vk_allocator(ALLOC_OBJECT_COMMAND_POOL), &vkCtx->commandPool) != VK_SUCCESS) {
         printf("Failed to create command pool\n");
         exit(1);
     }
 
-    // Allocate command buffers (one per swapchain image)
-    vkCtx->commandBuffers = malloc(vkCtx->imageCount * sizeof(VkCommandBuffer));
+    // Allocate command buffers (one per frame in flight)
     VkCommandBufferAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
     allocInfo.commandPool = vkCtx->commandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = vkCtx->imageCount;
+    allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
     if (vkAllocateCommandBuffers(vkCtx->device, &allocInfo, vkCtx->commandBuffers) != VK_SUCCESS) {
         printf("Failed to allocate command buffers\n");
         exit(1);
     }
 
-    // Create semaphores and fences
-    vkCtx->imageAvailableSemaphores = malloc(vkCtx->imageCount * sizeof(VkSemaphore));
-    vkCtx->renderFinishedSemaphores = malloc(vkCtx->imageCount * sizeof(VkSemaphore));
-    vkCtx->inFlightFences = malloc(vkCtx->imageCount * sizeof(VkFence));
-
+    // Create per-frame semaphores, plus one fence per frame when there is no frame timeline
     VkSemaphoreCreateInfo semaphoreInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
     VkFenceCreateInfo fenceInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
-        if (vkCreateSemaphore(vkCtx->device, &semaphoreInfo, NULL, &vkCtx->imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(vkCtx->device, &semaphoreInfo, NULL, &vkCtx->renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(vkCtx->device, &fenceInfo, NULL, &vkCtx->inFlightFences[i]) != VK_SUCCESS) {
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (vkCreateSemaphore(vkCtx->device, &semaphoreInfo, vk_allocator(ALLOC_OBJECT_SYNC), &vkCtx->imageAvailableSemaphores[i]) != VK_SUCCESS ||
+            (!vkCtx->timelineSupported &&
+             vkCreateFence(vkCtx->device, &fenceInfo, vk_allocator(ALLOC_OBJECT_SYNC), &vkCtx->inFlightFences[i]) != VK_SUCCESS)) {
             printf("Failed to create semaphores or fences\n");
             exit(1);
         }
+        vkCtx->frameValues[i] = 0;
+    }
+    if (vkCtx->timelineSupported) {
+        VkSemaphoreTypeCreateInfo typeInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+        VkSemaphoreCreateInfo timelineInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+        timelineInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(vkCtx->device, &timelineInfo, vk_allocator(ALLOC_OBJECT_SYNC), &vkCtx->frameTimeline) != VK_SUCCESS) {
+            printf("Failed to create frame timeline semaphore\n");
+            exit(1);
+        }
     }
+    printf("Frame sync: %s\n", vkCtx->timelineSupported ? "timeline semaphore" : "fences");
+    create_image_semaphores();
+    vkCtx->currentFrame = 0;
+    vkCtx->submittedFrame = 0;
+    vkCtx->completedFrame = 0;
+
+    // Staging uploads for static geometry
+    init_upload();
+    init_geometry();
+    init_record();
+    init_graph();
+    init_cull();
 }
 
 
@@ -537,7 +736,7 @@ void create_pipeline(void) {
     vertShaderInfo.codeSize = sizeof(triangle_vert_spv);
     vertShaderInfo.pCode = triangle_vert_spv;
     VkShaderModule vertModule;
-    if (vkCreateShaderModule(vkCtx->device, &vertShaderInfo, NULL, &vertModule) != VK_SUCCESS) {
+    if (vkCreateShaderModule(vkCtx->device, &vertShaderInfo, vk_allocator(ALLOC_OBJECT_SHADER_MODULE), &vertModule) != VK_SUCCESS) {
         printf("Failed to create vertex shader module\n");
         exit(1);
     }
@@ -546,7 +745,7 @@ void create_pipeline(void) {
     fragShaderInfo.codeSize = sizeof(triangle_frag_spv);
     fragShaderInfo.pCode = triangle_frag_spv;
     VkShaderModule fragModule;
-    if (vkCreateShaderModule(vkCtx->device, &fragShaderInfo, NULL, &fragModule) != VK_SUCCESS) {
+    if (vkCreateShaderModule(vkCtx->device, &fragShaderInfo, vk_allocator(ALLOC_OBJECT_SHADER_MODULE), &fragModule) != VK_SUCCESS) {
         printf("Failed to create fragment shader module\n");
         exit(1);
     }
@@ -602,9 +801,14 @@ void create_pipeline(void) {
     colorBlending.attachmentCount = 1;
     colorBlending.pAttachments = &colorBlendAttachment;
 
+    // Hot swap: frames in flight may still be using the current pipeline
+    vk_defer_destroy((uint64_t)vkCtx->graphicsPipeline, VK_OBJECT_TYPE_PIPELINE);
+    vk_defer_destroy((uint64_t)vkCtx->instancedPipeline, VK_OBJECT_TYPE_PIPELINE);
+    vk_defer_destroy((uint64_t)vkCtx->pipelineLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT);
+
     // Pipeline layout (unchanged)
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-    if (vkCreatePipelineLayout(vkCtx->device, &pipelineLayoutInfo, NULL, &vkCtx->pipelineLayout) != VK_SUCCESS) {
+    if (vkCreatePipelineLayout(vkCtx->device, &pipelineLayoutInfo, vk_allocator(ALLOC_OBJECT_PIPELINE), &vkCtx->pipelineLayout) != VK_SUCCESS) {
         printf("Failed to create pipeline layout\n");
         exit(1);
     }
@@ -624,14 +828,15 @@ void create_pipeline(void) {
     pipelineInfo.subpass = 0;
     pipelineInfo.pDynamicState = &dynamicState; // Add dynamic state
 
-    if (vkCreateGraphicsPipelines(vkCtx->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &vkCtx->graphicsPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(vkCtx->device, VK_NULL_HANDLE, 1, &pipelineInfo, vk_allocator(ALLOC_OBJECT_PIPELINE), &vkCtx->graphicsPipeline) != VK_SUCCESS) {
         printf("Failed to create graphics pipeline\n");
         exit(1);
     }
+    create_instanced_pipeline(&pipelineInfo);
 
     // Clean up shader modules
-    vkDestroyShaderModule(vkCtx->device, fragModule, NULL);
-    vkDestroyShaderModule(vkCtx->device, vertModule, NULL);
+    vkDestroyShaderModule(vkCtx->device, fragModule, vk_allocator(ALLOC_OBJECT_SHADER_MODULE));
+    vkDestroyShaderModule(vkCtx->device, vertModule, vk_allocator(ALLOC_OBJECT_SHADER_MODULE));
 }
 
 
@@ -656,85 +861,277 @@ void create_pipeline(void) {
 
 
 
-//vulkan render begin
-void vulkan_begin_render(uint32_t imageIndex) {
+// Wait for this frame slot, then acquire an image; the fence is only reset once an image is ours
+VkResult vulkan_acquire_frame(uint32_t* imageIndex) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    uint32_t frame = vkCtx->currentFrame;
+
+    vulkan_wait_frame(vkCtx->frameValues[frame]);
+    vk_defer_sweep();
+
+    VkResult result = vkAcquireNextImageKHR(vkCtx->device, vkCtx->swapchain, UINT64_MAX,
+                                            vkCtx->imageAvailableSemaphores[frame], VK_NULL_HANDLE, imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        return result;
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        printf("Failed to acquire swapchain image: %d\n", result);
+        exit(1);
+    }
+
+    // The image may still be in use by an older frame slot when images outnumber frames
+    vulkan_wait_frame(vkCtx->imagesInFlight[*imageIndex]);
+    vkCtx->imagesInFlight[*imageIndex] = vkCtx->submittedFrame + 1;
+    if (!vkCtx->timelineSupported) {
+        vkResetFences(vkCtx->device, 1, &vkCtx->inFlightFences[frame]);
+    }
+
+    if (vkResetCommandBuffer(vkCtx->commandBuffers[frame], 0) != VK_SUCCESS) {
+        printf("Failed to reset command buffer\n");
+        exit(1);
+    }
+    return result;
+}
+
+//vulkan frame begin; render passes, viewport and scissor are recorded by graph_execute
+CommandEncoder* vulkan_begin_frame(void) {
     VulkanContext* vkCtx = get_vulkan_context();
+    VkCommandBuffer commandBuffer = vkCtx->commandBuffers[vkCtx->currentFrame];
+
+    // This slot's previous frame has completed, recycle its dynamic upload segment
+    upload_frame_begin(vkCtx->currentFrame);
+    record_frame_begin(vkCtx->currentFrame);
+    encoder_frame_begin();
 
     // Begin command buffer
     VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    beginInfo.flags = 0; // Remove VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-    if (vkBeginCommandBuffer(vkCtx->commandBuffers[imageIndex], &beginInfo) != VK_SUCCESS) {
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // Re-recorded every frame
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         printf("Failed to begin command buffer\n");
         exit(1);
     }
 
-    // Begin render pass
-    VkRenderPassBeginInfo renderPassInfo = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-    renderPassInfo.renderPass = vkCtx->renderPass;
-    renderPassInfo.framebuffer = vkCtx->swapchainFramebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = (VkOffset2D){0, 0};
-    renderPassInfo.renderArea.extent = (VkExtent2D){vkCtx->width, vkCtx->height};
-    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
-
-    vkCmdBeginRenderPass(vkCtx->commandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // Take ownership of finished async uploads before anything reads them
+    if (!upload_acquire(commandBuffer, &uploadWaitSemaphore)) {
+        uploadWaitSemaphore = VK_NULL_HANDLE;
+    }
 
-    // Set viewport and scissor
-    VkViewport viewport = {0.0f, 0.0f, (float)vkCtx->width, (float)vkCtx->height, 0.0f, 1.0f};
-    vkCmdSetViewport(vkCtx->commandBuffers[imageIndex], 0, 1, &viewport);
+    // Geometry compaction copies have to be recorded outside the render pass
+    geometry_defrag_step(commandBuffer);
 
-    VkRect2D scissor = {{0, 0}, {vkCtx->width, vkCtx->height}};
-    vkCmdSetScissor(vkCtx->commandBuffers[imageIndex], 0, 1, &scissor);
+    encoder_begin(&frameEncoder, commandBuffer);
+    return &frameEncoder;
 }
 
 
-//vulkan render end
-void vulkan_end_render(uint32_t imageIndex, uint32_t semaphoreIndex) {
+//vulkan frame end, returns the present result so the caller can recreate the swapchain
+VkResult vulkan_end_frame(uint32_t imageIndex) {
     VulkanContext* vkCtx = get_vulkan_context();
+    uint32_t frame = vkCtx->currentFrame;
+    VkCommandBuffer commandBuffer = vkCtx->commandBuffers[frame];
 
-    // End render pass
-    vkCmdEndRenderPass(vkCtx->commandBuffers[imageIndex]);
+    // Every command buffer of the frame has been recorded
+    encoder_end(&frameEncoder);
+    encoder_frame_end();
 
     // End command buffer
-    if (vkEndCommandBuffer(vkCtx->commandBuffers[imageIndex]) != VK_SUCCESS) {
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         printf("Failed to end command buffer\n");
         exit(1);
     }
 
     // Submit command buffer
     VkSubmitInfo submitInfo = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    VkSemaphore waitSemaphores[] = {vkCtx->imageAvailableSemaphores[semaphoreIndex]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    VkSemaphore waitSemaphores[] = {vkCtx->imageAvailableSemaphores[frame], uploadWaitSemaphore};
+    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
+    submitInfo.waitSemaphoreCount = uploadWaitSemaphore != VK_NULL_HANDLE ? 2 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &vkCtx->commandBuffers[imageIndex];
-    VkSemaphore signalSemaphores[] = {vkCtx->renderFinishedSemaphores[semaphoreIndex]};
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VkSemaphore signalSemaphores[] = {vkCtx->renderFinishedSemaphores[imageIndex], vkCtx->frameTimeline};
+    submitInfo.signalSemaphoreCount = vkCtx->timelineSupported ? 2 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(vkCtx->graphicsQueue, 1, &submitInfo, vkCtx->inFlightFences[imageIndex]) != VK_SUCCESS) {
+    // Binary semaphores ignore their value; only the timeline entry matters
+    uint64_t frameValue = vkCtx->submittedFrame + 1;
+    uint64_t signalValues[] = {0, frameValue};
+    VkTimelineSemaphoreSubmitInfo timelineSubmit = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timelineSubmit.signalSemaphoreValueCount = 2;
+    timelineSubmit.pSignalSemaphoreValues = signalValues;
+    if (vkCtx->timelineSupported) {
+        submitInfo.pNext = &timelineSubmit;
+    }
+
+    VkFence fence = vkCtx->timelineSupported ? VK_NULL_HANDLE : vkCtx->inFlightFences[frame];
+    vulkan_lock_queue();
+    if (vkQueueSubmit(vkCtx->graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS) {
         printf("Failed to submit draw command buffer\n");
         exit(1);
     }
+    vulkan_unlock_queue();
+    uploadWaitSemaphore = VK_NULL_HANDLE;
+    vkCtx->frameValues[frame] = frameValue;
+    vkCtx->frameStartTimes[frame] = vkCtx->frameStartNs;
+    vkCtx->submittedFrame = frameValue;
 
     // Present the image
     VkPresentInfoKHR presentInfo = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = &vkCtx->renderFinishedSemaphores[imageIndex];
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &vkCtx->swapchain;
     presentInfo.pImageIndices = &imageIndex;
 
+    // Present id = frame number, so the pacer can wait for this exact frame to reach the display
+    VkPresentIdKHR presentId = {VK_STRUCTURE_TYPE_PRESENT_ID_KHR};
+    presentId.swapchainCount = 1;
+    presentId.pPresentIds = &frameValue;
+    if (vkCtx->presentWaitSupported) {
+        presentInfo.pNext = &presentId;
+    }
+
+    // Outside the queue lock, since present can block for a whole refresh. Once the render thread
+    // runs it makes every submit and present itself, so nothing else can touch the queue meanwhile.
     VkResult result = vkQueuePresentKHR(vkCtx->graphicsQueue, &presentInfo);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-        // Handle swapchain recreation in the main loop
-    } else if (result != VK_SUCCESS) {
+    vkCtx->currentFrame = (frame + 1) % MAX_FRAMES_IN_FLIGHT;
+    if (result != VK_SUCCESS && result != VK_ERROR_OUT_OF_DATE_KHR && result != VK_SUBOPTIMAL_KHR) {
         printf("Failed to present image: %d\n", result);
         exit(1);
     }
+    return result;
+}
+
+// Every frame up to `frame` has finished; newly finished frames feed the current mode's latency
+static void set_completed_frame(uint64_t frame) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (frame <= vkCtx->completedFrame) {
+        return;
+    }
+    FrameLatency* latency = NULL;
+    for (uint32_t i = 0; i < vkCtx->presentModeCount; i++) {
+        if (vkCtx->presentModes[i] == vkCtx->presentMode) {
+            latency = &vkCtx->presentLatency[i][vkCtx->bufferedImages - MIN_BUFFERED_IMAGES];
+        }
+    }
+    uint64_t now = SDL_GetTicksNS();
+    uint64_t newest = 0;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        uint64_t value = vkCtx->frameValues[i];
+        if (!latency || value <= vkCtx->completedFrame || value > frame || vkCtx->frameStartTimes[i] == 0) {
+            continue;
+        }
+        // Completion is only observed when we poll, so this is an upper bound
+        double ms = (double)(now - vkCtx->frameStartTimes[i]) / 1000000.0;
+        latency->samples++;
+        latency->averageMs += (ms - latency->averageMs) / (double)latency->samples;
+        if (value > newest) {
+            newest = value;
+            latency->lastMs = ms;
+        }
+    }
+    vkCtx->completedFrame = frame;
+}
+
+uint64_t vulkan_frame_submitted(void) {
+    return get_vulkan_context()->submittedFrame;
+}
+
+uint64_t vulkan_frame_completed(void) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (vkCtx->completedFrame == vkCtx->submittedFrame) {
+        return vkCtx->completedFrame;
+    }
+    if (vkCtx->timelineSupported) {
+        uint64_t value = 0;
+        if (getSemaphoreCounterValue(vkCtx->device, vkCtx->frameTimeline, &value) == VK_SUCCESS) {
+            set_completed_frame(value);
+        }
+        return vkCtx->completedFrame;
+    }
+
+    // One queue retires frames in order, so the newest signaled fence covers everything before it
+    uint64_t completed = vkCtx->completedFrame;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (vkCtx->frameValues[i] > completed &&
+            vkGetFenceStatus(vkCtx->device, vkCtx->inFlightFences[i]) == VK_SUCCESS) {
+            completed = vkCtx->frameValues[i];
+        }
+    }
+    set_completed_frame(completed);
+    return vkCtx->completedFrame;
+}
+
+void vulkan_wait_frame(uint64_t frame) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (frame <= vkCtx->completedFrame || frame > vkCtx->submittedFrame) {
+        return;
+    }
+    if (vkCtx->timelineSupported) {
+        VkSemaphoreWaitInfo waitInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &vkCtx->frameTimeline;
+        waitInfo.pValues = &frame;
+        waitSemaphores(vkCtx->device, &waitInfo, UINT64_MAX);
+        set_completed_frame(frame);
+        return;
+    }
+
+    // Frame N was submitted from slot (N - 1) % MAX_FRAMES_IN_FLIGHT; a newer value there means N already finished
+    uint32_t slot = (uint32_t)((frame - 1) % MAX_FRAMES_IN_FLIGHT);
+    if (vkCtx->frameValues[slot] == frame) {
+        vkWaitForFences(vkCtx->device, 1, &vkCtx->inFlightFences[slot], VK_TRUE, UINT64_MAX);
+    }
+    set_completed_frame(frame);
+}
+
+VkBool32 vulkan_set_present_mode(VkPresentModeKHR mode) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    if (mode == vkCtx->presentMode) {
+        return VK_FALSE;
+    }
+    for (uint32_t i = 0; i < vkCtx->presentModeCount; i++) {
+        if (vkCtx->presentModes[i] == mode) {
+            vkCtx->presentMode = mode;
+            printf("Present mode: %s\n", vulkan_present_mode_name(mode));
+            return VK_TRUE;
+        }
+    }
+    printf("Present mode %s is not supported by the surface\n", vulkan_present_mode_name(mode));
+    return VK_FALSE;
+}
+
+VkBool32 vulkan_set_buffered_images(uint32_t count) {
+    VulkanContext* vkCtx = get_vulkan_context();
+    count = SDL_clamp(count, MIN_BUFFERED_IMAGES, MAX_BUFFERED_IMAGES);
+    if (count == vkCtx->bufferedImages) {
+        return VK_FALSE;
+    }
+    vkCtx->bufferedImages = count;
+    printf("Swapchain buffering: %u images requested\n", count);
+    return VK_TRUE;
+}
+
+const char* vulkan_present_mode_name(VkPresentModeKHR mode) {
+    switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "Immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "Mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO relaxed";
+        default: return "Other";
+    }
+}
+
+void vulkan_frame_start(void) {
+    get_vulkan_context()->frameStartNs = SDL_GetTicksNS();
+}
+
+void vulkan_lock_queue(void) {
+    SDL_LockMutex(get_vulkan_context()->queueLock);
+}
+
+void vulkan_unlock_queue(void) {
+    SDL_UnlockMutex(get_vulkan_context()->queueLock);
 }
 
 
@@ -747,106 +1144,107 @@ void cleanup_vulkan(void) {
 
     // Destroy ImGui descriptor pool
     if (vkCtx->imguiDescriptorPool != VK_NULL_HANDLE) {
-        vkDestroyDescriptorPool(vkCtx->device, vkCtx->imguiDescriptorPool, NULL);
+        vkDestroyDescriptorPool(vkCtx->device, vkCtx->imguiDescriptorPool, vk_allocator(ALLOC_OBJECT_DESCRIPTOR));
         vkCtx->imguiDescriptorPool = VK_NULL_HANDLE;
     }
 
     // Destroy synchronization objects
-    for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         if (vkCtx->imageAvailableSemaphores[i] != VK_NULL_HANDLE) {
-            vkDestroySemaphore(vkCtx->device, vkCtx->imageAvailableSemaphores[i], NULL);
-        }
-        if (vkCtx->renderFinishedSemaphores[i] != VK_NULL_HANDLE) {
-            vkDestroySemaphore(vkCtx->device, vkCtx->renderFinishedSemaphores[i], NULL);
+            vkDestroySemaphore(vkCtx->device, vkCtx->imageAvailableSemaphores[i], vk_allocator(ALLOC_OBJECT_SYNC));
         }
         if (vkCtx->inFlightFences[i] != VK_NULL_HANDLE) {
-            vkDestroyFence(vkCtx->device, vkCtx->inFlightFences[i], NULL);
+            vkDestroyFence(vkCtx->device, vkCtx->inFlightFences[i], vk_allocator(ALLOC_OBJECT_SYNC));
+        }
+    }
+    if (vkCtx->frameTimeline != VK_NULL_HANDLE) {
+        vkDestroySemaphore(vkCtx->device, vkCtx->frameTimeline, vk_allocator(ALLOC_OBJECT_SYNC));
+    }
+    for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
+        if (vkCtx->renderFinishedSemaphores[i] != VK_NULL_HANDLE) {
+            vkDestroySemaphore(vkCtx->device, vkCtx->renderFinishedSemaphores[i], vk_allocator(ALLOC_OBJECT_SYNC));
         }
     }
-    free(vkCtx->imageAvailableSemaphores);
-    free(vkCtx->renderFinishedSemaphores);
-    free(vkCtx->inFlightFences);
 
     // Destroy command buffers
-    if (vkCtx->commandBuffers != NULL) {
-        vkFreeCommandBuffers(vkCtx->device, vkCtx->commandPool, vkCtx->imageCount, vkCtx->commandBuffers);
-        free(vkCtx->commandBuffers);
+    if (vkCtx->commandBuffers[0] != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(vkCtx->device, vkCtx->commandPool, MAX_FRAMES_IN_FLIGHT, vkCtx->commandBuffers);
     }
 
     // Destroy command pool
     if (vkCtx->commandPool != VK_NULL_HANDLE) {
-        vkDestroyCommandPool(vkCtx->device, vkCtx->commandPool, NULL);
+        vkDestroyCommandPool(vkCtx->device, vkCtx->commandPool, vk_allocator(ALLOC_OBJECT_COMMAND_POOL));
     }
 
-    // Destroy vertex and index buffers
-    if (vkCtx->vertexBuffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(vkCtx->device, vkCtx->vertexBuffer, NULL);
-    }
-    if (vkCtx->vertexMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(vkCtx->device, vkCtx->vertexMemory, NULL);
-    }
-    if (vkCtx->quadBuffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(vkCtx->device, vkCtx->quadBuffer, NULL);
-    }
-    if (vkCtx->quadMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(vkCtx->device, vkCtx->quadMemory, NULL);
-    }
-    if (vkCtx->quadIndexBuffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(vkCtx->device, vkCtx->quadIndexBuffer, NULL);
-    }
-    if (vkCtx->quadIndexMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(vkCtx->device, vkCtx->quadIndexMemory, NULL);
-    }
+    // Secondary command pools and recording threads
+    cleanup_record();
+
+    // Destroy upload staging resources
+    cleanup_upload();
+
+    // Destroy shared vertex and index pools
+    cleanup_geometry();
 
-    // Destroy swapchain resources
+    // Graph render passes, framebuffers and transient images go through the defer queue
+    cleanup_graph();
+
+    // Culling pipeline and instance buffers, also through the defer queue
+    cleanup_cull();
+
+    // Everything still queued for deferred destruction, then the live swapchain resources
+    vk_defer_flush();
     for (uint32_t i = 0; i < vkCtx->imageCount; i++) {
-        if (vkCtx->swapchainFramebuffers[i] != VK_NULL_HANDLE) {
-            vkDestroyFramebuffer(vkCtx->device, vkCtx->swapchainFramebuffers[i], NULL);
-        }
         if (vkCtx->swapchainImageViews[i] != VK_NULL_HANDLE) {
-            vkDestroyImageView(vkCtx->device, vkCtx->swapchainImageViews[i], NULL);
+            vkDestroyImageView(vkCtx->device, vkCtx->swapchainImageViews[i], vk_allocator(ALLOC_OBJECT_IMAGE_VIEW));
         }
     }
-    free(vkCtx->swapchainFramebuffers);
-    free(vkCtx->swapchainImageViews);
-    free(vkCtx->swapchainImages);
 
     if (vkCtx->swapchain != VK_NULL_HANDLE) {
-        vkDestroySwapchainKHR(vkCtx->device, vkCtx->swapchain, NULL);
+        vkDestroySwapchainKHR(vkCtx->device, vkCtx->swapchain, vk_allocator(ALLOC_OBJECT_SWAPCHAIN));
     }
 
     // Destroy pipeline
     if (vkCtx->graphicsPipeline != VK_NULL_HANDLE) {
-        vkDestroyPipeline(vkCtx->device, vkCtx->graphicsPipeline, NULL);
+        vkDestroyPipeline(vkCtx->device, vkCtx->graphicsPipeline, vk_allocator(ALLOC_OBJECT_PIPELINE));
+    }
+    if (vkCtx->instancedPipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(vkCtx->device, vkCtx->instancedPipeline, vk_allocator(ALLOC_OBJECT_PIPELINE));
     }
     if (vkCtx->pipelineLayout != VK_NULL_HANDLE) {
-        vkDestroyPipelineLayout(vkCtx->device, vkCtx->pipelineLayout, NULL);
+        vkDestroyPipelineLayout(vkCtx->device, vkCtx->pipelineLayout, vk_allocator(ALLOC_OBJECT_PIPELINE));
     }
     if (vkCtx->renderPass != VK_NULL_HANDLE) {
-        vkDestroyRenderPass(vkCtx->device, vkCtx->renderPass, NULL);
+        vkDestroyRenderPass(vkCtx->device, vkCtx->renderPass, vk_allocator(ALLOC_OBJECT_RENDER_PASS));
     }
 
+    // Release device memory blocks
+    cleanup_memory();
+
     // Destroy device
     if (vkCtx->device != VK_NULL_HANDLE) {
-        vkDestroyDevice(vkCtx->device, NULL);
+        vkDestroyDevice(vkCtx->device, vk_allocator(ALLOC_OBJECT_DEVICE));
     }
 
     // Destroy surface
     if (vkCtx->surface != VK_NULL_HANDLE) {
-        vkDestroySurfaceKHR(vkCtx->instance, vkCtx->surface, NULL);
+        vkDestroySurfaceKHR(vkCtx->instance, vkCtx->surface, vk_allocator(ALLOC_OBJECT_SURFACE));
     }
 
     // Destroy debug messenger
     if (vkCtx->debugMessenger != VK_NULL_HANDLE) {
         PFN_vkDestroyDebugUtilsMessengerEXT destroyDebugMessenger = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(vkCtx->instance, "vkDestroyDebugUtilsMessengerEXT");
         if (destroyDebugMessenger) {
-            destroyDebugMessenger(vkCtx->instance, vkCtx->debugMessenger, NULL);
+            destroyDebugMessenger(vkCtx->instance, vkCtx->debugMessenger, vk_allocator(ALLOC_OBJECT_DEBUG));
         }
     }
 
     // Destroy instance
     if (vkCtx->instance != VK_NULL_HANDLE) {
-        vkDestroyInstance(vkCtx->instance, NULL);
+        vkDestroyInstance(vkCtx->instance, vk_allocator(ALLOC_OBJECT_INSTANCE));
+    }
+    if (vkCtx->queueLock) {
+        SDL_DestroyMutex(vkCtx->queueLock);
+        vkCtx->queueLock = NULL;
     }
 
     free(vkCtx);